@@ -1,246 +1,534 @@
 #include "m61.hh"
-#include <map>
+#include "m61heap.hh"
+#include "m61trace.hh"
+#include "m61leak.hh"
+#include "m61prof.hh"
+#include "m61site.hh"
+#include "m61heapdump.hh"
+#include "m61shm.hh"
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <cstddef>
 #include <cstring>
 #include <cstdio>
 #include <cinttypes>
+#include <ctime>
 #include <cassert>
-#include <sys/mman.h>
-
-// ordered map for tracking: {pointers to live allocations => bytes of reserved memory}
-std::map<void*, size_t> active_ptrs;
-
-// ordered map for tracking: {pointers to free allocations => bytes of freed memory}
-std::map<void*, size_t> free_ptrs;
+#include <cerrno>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// the heap behind the C-style API; see m61heap.hh
+#if M61_COMPACT && M61_RELEASE
+using m61_api_policy = m61_compact_release_policy;
+#elif M61_COMPACT
+using m61_api_policy = m61_compact_policy;
+#elif M61_RELEASE
+using m61_api_policy = m61_release_policy;
+#else
+using m61_api_policy = m61_default_policy;
+#endif
+static m61_heap<m61_api_policy> default_heap;
+
+// Background maintenance (m61_maintenance_start() or M61_MAINTENANCE). While
+// the maintenance thread runs, API calls hold `heap_lock`, except frees from
+// threads other than the heap's owner, which only queue the block. The
+// thread holds the lock only for bounded steps, so a call waits briefly.
+static std::recursive_mutex heap_lock;
+static std::atomic<bool> heap_locking = false;
+static std::atomic<int> maint_state = -1;   // -1 unknown, 0 off, 1 on
+static std::once_flag maint_once;
+static std::thread maint_thread;
+static std::mutex maint_mutex;              // protects maint_stop
+static std::condition_variable maint_cv;
+static bool maint_stop;
+// statistics endpoint (m61_stats_publish()), protected by maint_mutex
+static m61_shm_stats* stats_segment;
+static std::chrono::milliseconds stats_interval;
+static std::chrono::steady_clock::time_point stats_due;
+
+// holds heap_lock for an API call while maintenance runs
+struct m61_api_guard {
+    bool locked;
+    m61_api_guard()
+        : locked(heap_locking.load(std::memory_order_acquire)) {
+        if(locked){
+            heap_lock.lock();
+        }
+    }
+    ~m61_api_guard() {
+        if(locked){
+            heap_lock.unlock();
+        }
+    }
+};
 
-using freemap_iter = std::map<void*, size_t>::iterator;
+static void m61_maintenance_init();
 
-void coalesce_up(freemap_iter it);
-bool can_coalesce_up(freemap_iter it);
-void consolidate_all_free_memory_regions(freemap_iter it);
-void* m61_find_free_space(size_t sz);
+// reads M61_MAINTENANCE and M61_STATS on the first allocating call
+static inline void m61_maintenance_check() {
+    if(maint_state.load(std::memory_order_relaxed) < 0){
+        std::call_once(maint_once, m61_maintenance_init);
+    }
+}
 
-struct m61_memory_buffer {
-    char* buffer; // pointer reference to first byte in buffer
-    size_t pos = 0;
-    size_t size = 8 << 20; /* 8 MiB ceiling of virtual memory*/
+// exclusive placement mode of this thread; see m61_set_exclusive()
+static thread_local bool exclusive_mode = false;
 
-    //constructor
-    m61_memory_buffer();
-    //deconstructor
-    ~m61_memory_buffer();
-};
+// trace op for an allocation made in the current placement mode
+static inline m61_trace_op m61_trace_alloc_op(m61_trace_op op) {
+    return exclusive_mode ? m61_trace_op(op | M61_TRACE_EXCLUSIVE) : op;
+}
 
-static m61_memory_buffer default_buffer;
-
-static m61_statistics alloc_stats = {
-    .nactive = 0,
-    .active_size = 0,
-    .ntotal = 0,
-    .total_size = 0,
-    .nfail = 0,
-    .fail_size = 0,
-    .heap_min = 0,
-    .heap_max = 0
-};
 
+/// m61_malloc(sz, file, line)
+///    Returns a pointer to `sz` bytes of freshly-allocated dynamic memory.
+///    The memory is not initialized. If `sz == 0`, then m61_malloc may
+///    return either `nullptr` or a pointer to a unique allocation.
+///    The allocation request was made at source code location `file`:`line`.
 
-int get_padding(void* ptr, size_t sz){
-    size_t padding = 0;
-    if(((uintptr_t) ptr + sz) % 16 != 0){
-        padding = 16 - (((uintptr_t) ptr + sz) % 16);
+void* m61_malloc(size_t sz, const char* file, int line) {
+    m61_maintenance_check();
+    m61_api_guard guard;
+    uint64_t t0 = m61_prof_enabled() ? m61_cycles() : 0;
+    void* ptr = default_heap.allocate(sz, file, line, exclusive_mode);
+    if(t0){
+        m61_prof_record(M61_PROF_MALLOC, m61_cycles() - t0);
     }
-    return padding;
+    M61_PROBE2(malloc, ptr, sz);
+    if(m61_trace_enabled()){
+        m61_trace(m61_trace_alloc_op(M61_TRACE_MALLOC), ptr, sz, file, line);
+    }
+    return ptr;
 }
 
-m61_memory_buffer::m61_memory_buffer() {
-    /*
-    mmap() function asks the kernel to create new virtual memory area,
-    preferably one that starts at address "nullptr" and map to a contiguous object
-    chunk of the object specified by file descriptor fd = -1 to the new area    
-    */
-    void* buf = mmap(nullptr,    // Place the buffer at a random address
-        this->size,              // Buffer/Virtual Memory should be 8 MiB big or 2^23 = 8,388,608 bytes
-        PROT_WRITE,              // We want to read and write the buffer
-        MAP_ANON | MAP_PRIVATE, -1, 0);
-                                 // We want memory freshly allocated by the OS
-    assert(buf != MAP_FAILED);
 
-    //pointer to virtual memory returned from mmap() persists in buffer attribute of "m61_memory_buffer" struct
-    this->buffer = (char*) buf;
-    //printf("Buffer pointer %li\n", (uintptr_t) this->buffer); 
+/// m61_malloc_exclusive(sz, file, line)
+///    Like m61_malloc, but the block has its cache lines to itself. Profiled
+///    as a malloc; traced as a malloc flagged M61_TRACE_EXCLUSIVE.
 
-    alloc_stats.heap_min = (uintptr_t) buf;
-    alloc_stats.heap_max = (uintptr_t) buf + this->size;
+void* m61_malloc_exclusive(size_t sz, const char* file, int line) {
+    bool was = m61_set_exclusive(true);
+    void* ptr = m61_malloc(sz, file, line);
+    m61_set_exclusive(was);
+    return ptr;
 }
 
-m61_memory_buffer::~m61_memory_buffer() {
-    //deletes the area starting at virtual address "this.buffer" and consisting of next "size" bytes 
-    munmap(this->buffer, this->size);
+
+/// m61_set_exclusive(on)
+///    Sets the calling thread's exclusive placement mode.
+
+bool m61_set_exclusive(bool on) {
+    bool was = exclusive_mode;
+    exclusive_mode = on;
+    return was;
 }
 
-// helper function for m61_malloc()
-// always checks diff(heap ceiling - default buffer.current_pos) first to see if an allocation reside there first
-// otherwise, checks free regions of memory
-void* m61_find_free_space(size_t sz){
-    // try default_buffer (i.e. check distance or space from current buffer.pos heap_max or ceiling)
-    if (sz <= default_buffer.size - default_buffer.pos) {
 
-        void* ptr = &default_buffer.buffer[default_buffer.pos]; //getting pointer at 0th position in 8 MiB buffer block or essentially heap_min
+/// m61_free(ptr, file, line)
+///    Frees the memory allocation pointed to by `ptr`. If `ptr == nullptr`,
+///    does nothing. Otherwise, `ptr` must point to a currently active
+///    allocation returned by `m61_malloc`. The free was called at location
+///    `file`:`line`.
+
+void m61_free(void* ptr, const char* file, int line) {
+    if(m61_trace_enabled()){
+        m61_trace(M61_TRACE_FREE, ptr, 0, file, line);
+    }
+    M61_PROBE1(free, ptr);
+    uint64_t t0 = m61_prof_enabled() ? m61_cycles() : 0;
+    // a cross-thread free only queues the block, so it takes no lock
+    if(!default_heap.free_remote(ptr, file, line)){
+        m61_api_guard guard;
+        default_heap.free(ptr, file, line);
+    }
+    if(t0){
+        m61_prof_record(M61_PROF_FREE, m61_cycles() - t0);
+    }
+}
 
-        // address value returned by m61_malloc() must be evenly divisible by 16
-        int padding = get_padding(ptr, sz);
-        default_buffer.pos += sz + padding;
-        active_ptrs.insert({ptr, sz});
 
-        alloc_stats.active_size += sz;
-        alloc_stats.nactive++;
-        return ptr;
+/// m61_calloc(count, sz, file, line)
+///    Returns a pointer a fresh dynamic memory allocation big enough to
+///    hold an array of `count` elements of `sz` bytes each. Returned
+///    memory is initialized to zero. The allocation request was at
+///    location `file`:`line`. Returns `nullptr` if out of memory; may
+///    also return `nullptr` if `count == 0` or `size == 0`.
+
+void* m61_calloc(size_t count, size_t sz, const char* file, int line) {
+    m61_maintenance_check();
+    m61_api_guard guard;
+    uint64_t t0 = m61_prof_enabled() ? m61_cycles() : 0;
+    void* ptr = default_heap.calloc(count, sz, file, line, exclusive_mode);
+    if(t0){
+        m61_prof_record(M61_PROF_CALLOC, m61_cycles() - t0);
+    }
+    M61_PROBE2(calloc, ptr, count * sz);
+    if(m61_trace_enabled()){
+        bool overflow = sz != 0 && count > SIZE_MAX / sz;
+        m61_trace(m61_trace_alloc_op(M61_TRACE_CALLOC), ptr,
+                  overflow ? UINT64_MAX : count * sz, file, line);
     }
+    return ptr;
+}
 
-    // just-in-time coalescing!
-    auto iter = free_ptrs.begin();
-    consolidate_all_free_memory_regions(iter);
 
-    // scans free_ptr map and find an available buffer zone that's less than or equal to size
-    for (auto it = free_ptrs.begin(); it != free_ptrs.end(); ++it) {
-        if(sz <= it->second){
-            void* ptr = it->first;
-            free_ptrs.erase(ptr);
+/// m61_realloc(ptr, sz, file, line)
+///    Resizes the allocation at `ptr` to `sz` bytes, copying it to a new
+///    block unless the old block's footprint already fits. A trace records
+///    the old block's free before the new block's allocation.
 
-            active_ptrs.insert({ptr, sz});
-            alloc_stats.active_size += sz;
-            return ptr;
+void* m61_realloc(void* ptr, size_t sz, const char* file, int line) {
+    m61_maintenance_check();
+    m61_api_guard guard;
+    uint64_t t0 = m61_prof_enabled() ? m61_cycles() : 0;
+    void* newptr = default_heap.reallocate(ptr, sz, file, line, exclusive_mode);
+    if(t0){
+        m61_prof_record(M61_PROF_REALLOC, m61_cycles() - t0);
+    }
+    M61_PROBE2(realloc, ptr, newptr);
+    if(m61_trace_enabled()){
+        if(ptr && (newptr || sz == 0)){
+            m61_trace(M61_TRACE_FREE, ptr, 0, file, line);
+        }
+        if(sz != 0 || !ptr){
+            m61_trace(m61_trace_alloc_op(M61_TRACE_MALLOC), newptr, sz, file, line);
         }
     }
+    return newptr;
+}
 
-    alloc_stats.nfail++;
-    alloc_stats.fail_size += sz;
-    alloc_stats.ntotal--;
-    alloc_stats.total_size -= sz;
-    return nullptr;
+
+/// m61_handle_alloc(sz, file, line)
+///    Returns the handle of a fresh relocatable block of `sz` bytes, or 0.
+///    Handle blocks are not traced, since m61_compact() moves them.
+
+m61_handle m61_handle_alloc(size_t sz, const char* file, int line) {
+    m61_maintenance_check();
+    m61_api_guard guard;
+    return default_heap.handle_allocate(sz, file, line);
 }
 
 
-/// m61_malloc(sz, file, line)
-///    Returns a pointer to `sz` bytes of freshly-allocated dynamic memory.
-///    The memory is not initialized. If `sz == 0`, then m61_malloc may
-///    return either `nullptr` or a pointer to a unique allocation.
-///    The allocation request was made at source code location `file`:`line`.
+/// m61_handle_free(h, file, line)
+///    Frees the block of handle `h`.
 
-void* m61_malloc(size_t sz, const char* file, int line) {
-    (void) file, (void) line;   // avoid uninitialized variable warnings
-    alloc_stats.ntotal++;
-    alloc_stats.total_size += sz;
+void m61_handle_free(m61_handle h, const char* file, int line) {
+    m61_api_guard guard;
+    default_heap.handle_free(h, file, line);
+}
 
-    return m61_find_free_space(sz);
+
+/// m61_pin(h), m61_unpin(h)
+///    Pins handle `h`'s block in place and returns its address; unpins it.
+
+void* m61_pin(m61_handle h) {
+    m61_api_guard guard;
+    return default_heap.pin(h);
 }
 
-bool can_coalesce_up(freemap_iter it){
-    assert(it != free_ptrs.end());
+void m61_unpin(m61_handle h) {
+    m61_api_guard guard;
+    default_heap.unpin(h);
+}
 
-    auto nextBlock = it;
-    nextBlock++;
 
-    if(nextBlock == free_ptrs.end()){
-        return false;
-    }
+/// m61_compact()
+///    Slides unpinned handle-owned blocks together and returns the freed
+///    tail of the heap to the OS.
 
-    // cannot coalesce if there's no next entry in free_ptrs map!
-    if(free_ptrs.find(nextBlock->first) == free_ptrs.end()){
-        return false;
-    }
+size_t m61_compact() {
+    m61_api_guard guard;
+    return default_heap.compact();
+}
 
-    return ((uintptr_t) it->first) + it->second == (uintptr_t) nextBlock->first;
+
+/// m61_set_heap_limits(soft, hard)
+///    Sets the default heap's soft and hard limits.
+
+void m61_set_heap_limits(size_t soft, size_t hard) {
+    m61_api_guard guard;
+    default_heap.set_limits(soft, hard);
 }
 
-void coalesce_up(freemap_iter it){
-    if(can_coalesce_up(it)){
-        auto next = it;
-        next++;
-        // consolidate free blocks by adding next value's memory allocation to current block
-        it->second += next->second;
 
-        // update free ptrs map to contain consolidated buffer
-        free_ptrs.insert_or_assign(it->first, it->second);
+/// m61_add_pressure_callback(callback, ctx), m61_remove_pressure_callback(callback, ctx)
+///    Manage the default heap's memory-pressure callbacks.
 
-        // erasing stale pointer
-        free_ptrs.erase(next->first);
-    }
+void m61_add_pressure_callback(m61_pressure_callback callback, void* ctx) {
+    m61_api_guard guard;
+    default_heap.add_pressure_callback(callback, ctx);
+}
 
+int m61_remove_pressure_callback(m61_pressure_callback callback, void* ctx) {
+    m61_api_guard guard;
+    return default_heap.remove_pressure_callback(callback, ctx) ? 0 : -1;
 }
 
-// DEFERRED COALESCING TECHNIQUE
-void consolidate_all_free_memory_regions(freemap_iter it){
 
-    // DECENT BETTER!! Iterator goes through all of the free elements in the map and performs consolidation
-    // if it cannot, it simply skips that over and goes to next ... it doesn't short circuit prematurely 
-    // if an adjacent free block cannot coalesce!!
-    for (; it != free_ptrs.end(); it++) {
-        coalesce_up(it);
-    }
+/// m61_coalesce_step(budget)
+///    Runs a bounded step of free-block coalescing on the default heap.
+
+size_t m61_coalesce_step(size_t budget) {
+    m61_api_guard guard;
+    return default_heap.coalesce_step(budget);
 }
 
-/// m61_free(ptr, file, line)
-///    Frees the memory allocation pointed to by `ptr`. If `ptr == nullptr`,
-///    does nothing. Otherwise, `ptr` must point to a currently active
-///    allocation returned by `m61_malloc`. The free was called at location
-///    `file`:`line`.
 
-void m61_free(void* ptr, const char* file, int line) {
-    // avoid uninitialized variable warnings
-    (void) ptr, (void) file, (void) line;
-    if(ptr != nullptr){
-        // prevent integer wraparound
-        if(alloc_stats.nactive != 0){
-            alloc_stats.nactive--;
+/// m61_maintenance_start(interval_ms), m61_maintenance_stop()
+///    Start or stop the background maintenance thread. Each round drains
+///    remote frees and runs a coalescing step with the heap locked, checks
+///    out a few large free blocks whose pages are still resident, releases
+///    their pages with madvise() with the heap unlocked, and returns them.
+///    Rounds due to publish statistics also gather them with the heap
+///    locked and copy them out to the segment after unlocking.
+
+static void m61_collect_published(m61_shm_payload* data,
+                                  std::vector<m61_site_total>& totals);
+static void m61_rank_published(m61_shm_payload* data,
+                               const std::vector<m61_site_total>& totals);
+
+static void m61_maintenance_loop(unsigned interval_ms) {
+    using heap_type = decltype(default_heap);
+    constexpr size_t budget = 64;               // free blocks examined per round
+    constexpr size_t min_trim = 64 << 10;       // smallest block worth trimming
+    constexpr size_t max_trim = 8;              // blocks trimmed per round
+    heap_type::trim_range blocks[max_trim];
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    auto data = std::make_unique<m61_shm_payload>();
+    std::vector<m61_site_total> site_totals;
+
+    std::unique_lock<std::mutex> lk(maint_mutex);
+    while(!maint_cv.wait_for(lk, std::chrono::milliseconds(interval_ms),
+                             [] { return maint_stop; })){
+        // the application is using the heap: skip this round
+        if(!heap_lock.try_lock()){
+            continue;
         }
-        auto iter = active_ptrs.find(ptr);
-
-        // can only free from m61_malloc() map
-        if(iter != active_ptrs.end()){
-            // FIXME: consider padding too!
-            free_ptrs.insert({ptr, iter->second});
-            default_buffer.pos -= iter->second;
-
-            alloc_stats.active_size -= iter->second;
-            active_ptrs.erase(ptr);
+        size_t n = default_heap.maintain(budget, min_trim, blocks, max_trim);
+        heap_lock.unlock();
+        auto now = std::chrono::steady_clock::now();
+        if(stats_segment && now >= stats_due){
+            m61_collect_published(data.get(), site_totals);
+            m61_rank_published(data.get(), site_totals);
+            m61_shm_publish(stats_segment, *data);
+            stats_due = now + stats_interval;
         }
-        else{
-            //double free detection... causing previous test cases to fail so commenting out
-            if(free_ptrs.find(ptr) != free_ptrs.end()){
-                fprintf(stderr, "MEMORY BUG %s:%i: invalid free of pointer %p, double free\n", file, line, ptr);
-            }
-            else{
-               fprintf(stderr, "MEMORY BUG %s:%i: invalid free of pointer %p, not in heap\n", file, line, ptr); 
+        if(n == 0){
+            continue;
+        }
+
+        // the checked-out blocks belong to nobody: release their whole pages
+        for(size_t i = 0; i != n; ++i){
+            uintptr_t first = ((uintptr_t) blocks[i].first + page - 1) & ~(page - 1);
+            uintptr_t last = ((uintptr_t) blocks[i].first + blocks[i].second) & ~(page - 1);
+            if(first < last){
+                madvise((void*) first, last - first, MADV_DONTNEED);
             }
-            abort();
         }
-        // ===================================
+        std::lock_guard<std::recursive_mutex> guard(heap_lock);
+        default_heap.return_trimmed(blocks, n);
     }
 }
 
+// fork() copies only the forking thread. The heap lock is held across the
+// fork, so the child's heap is not caught halfway through a maintenance
+// step; the child then forgets the thread without joining it, and runs
+// without heap locking, as if maintenance had been stopped.
+static bool fork_locked;
 
-/// m61_calloc(count, sz, file, line)
-///    Returns a pointer a fresh dynamic memory allocation big enough to
-///    hold an array of `count` elements of `sz` bytes each. Returned
-///    memory is initialized to zero. The allocation request was at
-///    location `file`:`line`. Returns `nullptr` if out of memory; may
-///    also return `nullptr` if `count == 0` or `size == 0`.
+static void m61_fork_prepare() {
+    fork_locked = heap_locking.load(std::memory_order_acquire);
+    if(fork_locked){
+        heap_lock.lock();
+    }
+}
 
-void* m61_calloc(size_t count, size_t sz, const char* file, int line) {
-    // first 2 statements checks if result (i.e. y = a*b) is less than either of the factors which implies a wraparound occurred
-    // last statement checks if new allocation doesn't exceed buffer threshold
-    if((sz * count) < count || (sz * count) < sz || default_buffer.pos + (sz * count) > default_buffer.size){
-        alloc_stats.nfail++;
-        return nullptr;
+static void m61_fork_parent() {
+    if(fork_locked){
+        heap_lock.unlock();
     }
-    void* ptr = m61_malloc(count * sz, file, line);
-    if (ptr) {
-        memset(ptr, 0, count * sz);
+}
+
+static void m61_fork_child() {
+    // the segment is the parent's; the child publishes nothing
+    if(stats_segment){
+        m61_shm_destroy(stats_segment);
+        stats_segment = nullptr;
+    }
+    if(!fork_locked){
+        return;
+    }
+    // the old objects may be held by threads that do not exist here
+    new (&heap_lock) std::recursive_mutex;
+    new (&maint_mutex) std::mutex;
+    new (&maint_cv) std::condition_variable;
+    new (&maint_thread) std::thread;
+    heap_locking.store(false, std::memory_order_release);
+    maint_state = 0;
+}
+
+void m61_maintenance_start(unsigned interval_ms) {
+    if(heap_locking.load(std::memory_order_relaxed)){
+        return;
+    }
+    maint_stop = false;
+    heap_locking.store(true, std::memory_order_release);
+    maint_thread = std::thread(m61_maintenance_loop, std::max(interval_ms, 1U));
+    maint_state = 1;
+    static std::once_flag exit_once;
+    std::call_once(exit_once, [] {
+        // before default_heap is destroyed
+        atexit(m61_maintenance_stop);
+        pthread_atfork(m61_fork_prepare, m61_fork_parent, m61_fork_child);
+    });
+}
+
+void m61_maintenance_stop() {
+    if(!maint_thread.joinable()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(maint_mutex);
+        maint_stop = true;
+    }
+    maint_cv.notify_one();
+    maint_thread.join();
+    heap_locking.store(false, std::memory_order_release);
+    maint_state = 0;
+}
+
+// start maintenance on the first allocation if M61_MAINTENANCE names an
+// interval, and publishing if M61_STATS does
+static void m61_maintenance_init() {
+    const char* s = getenv("M61_MAINTENANCE");
+    unsigned interval_ms = s ? strtoul(s, nullptr, 10) : 0;
+    if(interval_ms != 0){
+        m61_maintenance_start(interval_ms);
+    }
+    s = getenv("M61_STATS");
+    unsigned stats_ms = s ? strtoul(s, nullptr, 10) : 0;
+    if(stats_ms != 0 && m61_stats_publish(stats_ms) != 0){
+        fprintf(stderr, "m61: cannot create statistics segment\n");
+    }
+    // unless m61_maintenance_start() got there first
+    int unknown = -1;
+    maint_state.compare_exchange_strong(unknown, 0);
+}
+
+
+/// m61_stats_publish(interval_ms)
+///    Creates, retimes or removes the statistics segment. The maintenance
+///    thread fills it: m61_collect_published() copies the counters under
+///    short holds of the heap lock, and sites are ranked and copied into
+///    shared memory without it.
+
+static_assert(m61_shm_hist_buckets == m61_hist_buckets);
+
+static void m61_stats_unpublish() {
+    std::lock_guard<std::mutex> lk(maint_mutex);
+    if(stats_segment){
+        m61_shm_destroy(stats_segment);
+        stats_segment = nullptr;
+    }
+}
+
+int m61_stats_publish(unsigned interval_ms) {
+    if(interval_ms == 0){
+        m61_stats_unpublish();
+        return 0;
+    }
+    {
+        std::lock_guard<std::mutex> lk(maint_mutex);
+        if(!stats_segment && !(stats_segment = m61_shm_create(interval_ms))){
+            return -1;
+        }
+        stats_segment->interval_ms = interval_ms;
+        stats_interval = std::chrono::milliseconds(interval_ms);
+        stats_due = {};                         // publish on the next round
+    }
+    if(!heap_locking.load(std::memory_order_relaxed)){
+        m61_maintenance_start(interval_ms);
+    }
+    static std::once_flag exit_once;
+    std::call_once(exit_once, [] {
+        atexit(m61_stats_unpublish);
+    });
+    return 0;
+}
+
+// fills `data` for publication, except its sites, and copies the per-site
+// totals to `totals`; called by the maintenance thread. The heap keeps every
+// counter as blocks come and go, so nothing is walked, and the heap is
+// locked only for short copies: the fixed-size counters, then the site
+// totals a chunk at a time, so an API call waits for one chunk at most.
+static void m61_collect_published(m61_shm_payload* data,
+                                  std::vector<m61_site_total>& totals) {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    {
+        std::lock_guard<std::recursive_mutex> guard(heap_lock);
+        data->stats = default_heap.statistics();
+        memcpy(data->size_hist, default_heap.size_histogram(), sizeof(data->size_hist));
+        memcpy(data->lifetime_hist, default_heap.lifetime_histogram(), sizeof(data->lifetime_hist));
+    }
+    ++data->updates;
+    data->time_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    data->histogram_sampling = m61_api_policy::histogram_sampling;
+
+    constexpr size_t chunk = 256;
+    totals.reserve(m61_site_count() + 1);
+    totals.clear();
+    for(size_t i = 0; ; i += chunk){
+        std::lock_guard<std::recursive_mutex> guard(heap_lock);
+        const std::vector<m61_site_total>& kept = default_heap.site_totals();
+        if(i >= kept.size()){
+            break;
+        }
+        totals.insert(totals.end(), kept.begin() + i,
+                      kept.begin() + std::min(i + chunk, kept.size()));
+    }
+}
+
+// fills `data`'s top sites, by active bytes, from the copied `totals`;
+// called after unlocking
+static void m61_rank_published(m61_shm_payload* data,
+                               const std::vector<m61_site_total>& totals) {
+    static std::vector<uint32_t> order;
+    order.clear();
+    for(uint32_t site = 0; site != totals.size(); ++site){
+        if(totals[site].nactive != 0){
+            order.push_back(site);
+        }
+    }
+    size_t nsites = std::min(order.size(), m61_shm_nsites);
+    std::partial_sort(order.begin(), order.begin() + nsites, order.end(),
+                      [&] (uint32_t a, uint32_t b) {
+        return totals[a].bytes != totals[b].bytes ? totals[a].bytes > totals[b].bytes : a < b;
+    });
+    data->nsites = nsites;
+    for(size_t i = 0; i != nsites; ++i){
+        m61_shm_site& out = data->sites[i];
+        out.site = order[i];
+        out.line = m61_site_line(order[i]);
+        out.nactive = totals[order[i]].nactive;
+        out.bytes = totals[order[i]].bytes;
+        // keep the end of long paths, which names the file
+        const char* file = m61_site_file(order[i]);
+        size_t len = strlen(file);
+        if(len >= sizeof(out.file)){
+            file += len - (sizeof(out.file) - 1);
+        }
+        snprintf(out.file, sizeof(out.file), "%s", file);
     }
-    return ptr;
 }
 
 
@@ -248,7 +536,8 @@ void* m61_calloc(size_t count, size_t sz, const char* file, int line) {
 ///    Return the current memory statistics.
 
 m61_statistics m61_get_statistics() {
-    return alloc_stats;
+    m61_api_guard guard;
+    return default_heap.statistics();
 }
 
 
@@ -264,10 +553,221 @@ void m61_print_statistics() {
 }
 
 
+// writes `name`: [{"min": lo, "max": hi, "count": n}, ...] for nonempty buckets
+static void m61_json_histogram(FILE* f, const char* name, const unsigned long long* hist){
+    fprintf(f, "  \"%s\": [", name);
+    const char* sep = "";
+    for(int b = 0; b != m61_hist_buckets; ++b){
+        if(hist[b] != 0){
+            unsigned long long lo = b == 0 ? 0 : 1ULL << (b - 1);
+            unsigned long long hi = b == 0 ? 0 : (b == 64 ? ~0ULL : (1ULL << b) - 1);
+            fprintf(f, "%s\n    {\"min\": %llu, \"max\": %llu, \"count\": %llu}", sep, lo, hi, hist[b]);
+            sep = ",";
+        }
+    }
+    fprintf(f, "%s]", *sep ? "\n  " : "");
+}
+
+
+/// m61_dump_stats_json(f)
+///    Writes the current statistics and the request-size and lifetime
+///    histograms to `f` as a JSON object.
+
+void m61_dump_stats_json(FILE* f) {
+    m61_api_guard guard;
+    m61_statistics stats = m61_get_statistics();
+    fprintf(f, "{\n");
+    fprintf(f, "  \"nactive\": %llu,\n  \"active_size\": %llu,\n", stats.nactive, stats.active_size);
+    fprintf(f, "  \"ntotal\": %llu,\n  \"total_size\": %llu,\n", stats.ntotal, stats.total_size);
+    fprintf(f, "  \"nfail\": %llu,\n  \"fail_size\": %llu,\n", stats.nfail, stats.fail_size);
+    fprintf(f, "  \"heap_min\": %" PRIuPTR ",\n  \"heap_max\": %" PRIuPTR ",\n", stats.heap_min, stats.heap_max);
+    fprintf(f, "  \"free_size\": %llu,\n  \"nfree\": %llu,\n", stats.free_size, stats.nfree);
+    fprintf(f, "  \"largest_free\": %llu,\n  \"fragmentation\": %.6f,\n", stats.largest_free, stats.fragmentation);
+    fprintf(f, "  \"padding_size\": %llu,\n  \"metadata_size\": %llu,\n", stats.padding_size, stats.metadata_size);
+    fprintf(f, "  \"lifetime_unit\": \"allocations\",\n");
+    fprintf(f, "  \"histogram_sampling\": %u,\n", m61_api_policy::histogram_sampling);
+    m61_json_histogram(f, "size_histogram", default_heap.size_histogram());
+    fprintf(f, ",\n");
+    m61_json_histogram(f, "lifetime_histogram", default_heap.lifetime_histogram());
+    fprintf(f, "\n}\n");
+}
+
+
+/// m61_profile_enable(on)
+///    Turns per-operation cycle profiling on or off.
+
+void m61_profile_enable(bool on) {
+    m61_prof_on.store(on, std::memory_order_relaxed);
+}
+
+
+/// m61_dump_profile_json(f)
+///    Writes the profile's per-operation cycle histograms, summed over
+///    threads, to `f` as a JSON object.
+
+void m61_dump_profile_json(FILE* f) {
+    static const char* const names[M61_PROF_NOPS] = {
+        "malloc", "free", "calloc", "realloc", "coalesce"
+    };
+    unsigned long long hist[M61_PROF_NOPS][m61_hist_buckets];
+    m61_prof_totals(hist);
+    fprintf(f, "{\n");
+#if defined(__x86_64__) || defined(__i386__)
+    fprintf(f, "  \"unit\": \"cycles\",\n");
+#else
+    fprintf(f, "  \"unit\": \"ns\",\n");
+#endif
+    for(int op = 0; op != M61_PROF_NOPS; ++op){
+        unsigned long long count = 0;
+        for(int b = 0; b != m61_hist_buckets; ++b){
+            count += hist[op][b];
+        }
+        fprintf(f, "  \"%s_count\": %llu,\n", names[op], count);
+        char name[32];
+        snprintf(name, sizeof(name), "%s_histogram", names[op]);
+        m61_json_histogram(f, name, hist[op]);
+        fprintf(f, op + 1 != M61_PROF_NOPS ? ",\n" : "\n");
+    }
+    fprintf(f, "}\n");
+}
+
+
+/// m61_heap_walk(callback, ctx)
+///    Calls `callback(block, ctx)` for every block in the heap in address
+///    order: active allocations, free blocks, and the never-allocated tail.
+///    Walks the live and free maps side by side in one pass, without
+///    allocating. Stops early and returns the callback's value if it
+///    returns nonzero; otherwise returns 0.
+
+int m61_heap_walk(int (*callback)(const m61_block_info* block, void* ctx), void* ctx) {
+    m61_api_guard guard;
+    return default_heap.walk(callback, ctx);
+}
+
+
+/// m61_heap_dump(path, flags)
+///    Writes a heap dump to `path` from a forked child. The heap is locked
+///    only across fork(); the child walks its copy of the heap directly,
+///    since `heap_lock` belongs to a thread that does not exist there. The
+///    child leaves remote frees queued: draining them could allocate.
+
+int m61_heap_dump(const char* path, int flags) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0){
+        return -1;
+    }
+    pid_t child;
+    {
+        m61_api_guard guard;
+        child = fork();
+        if(child == 0){
+            bool ok = m61_dump_write(fd, flags, [] (auto callback, void* ctx) {
+                return default_heap.walk(callback, ctx, false);
+            });
+            _exit(ok ? 0 : 1);
+        }
+    }
+    close(fd);
+    if(child < 0){
+        return -1;
+    }
+    if(flags & M61_DUMP_ASYNC){
+        return child;
+    }
+    int status;
+    while(waitpid(child, &status, 0) < 0){
+        if(errno != EINTR){
+            return -1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+
 /// m61_print_leak_report()
 ///    Prints a report of all currently-active allocated blocks of dynamic
 ///    memory.
 
 void m61_print_leak_report() {
-    // Your code here.
+    m61_heap_walk([] (const m61_block_info* b, void*) {
+        if(b->state == M61_BLOCK_ACTIVE){
+            printf("LEAK CHECK: %s:%d: allocated object %p with size %zu\n",
+                   b->file, b->line, b->ptr, b->size);
+        }
+        return 0;
+    }, nullptr);
+}
+
+
+/// m61_print_site_statistics()
+///    Prints the active blocks of each allocation site, largest total
+///    first. Totals are indexed by site ID, so no file names are compared.
+
+void m61_print_site_statistics() {
+    struct site_total {
+        uint32_t site;
+        size_t n;
+        size_t bytes;
+    };
+    std::vector<site_total> totals(m61_site_count() + 1);
+    for(size_t i = 0; i != totals.size(); ++i){
+        totals[i] = {(uint32_t) i, 0, 0};
+    }
+    m61_heap_walk([] (const m61_block_info* b, void* arg) {
+        auto& t = *(std::vector<site_total>*) arg;
+        if(b->state == M61_BLOCK_ACTIVE && b->site < t.size()){
+            ++t[b->site].n;
+            t[b->site].bytes += b->size;
+        }
+        return 0;
+    }, &totals);
+
+    std::sort(totals.begin(), totals.end(), [] (const site_total& a, const site_total& b) {
+        return a.bytes != b.bytes ? a.bytes > b.bytes : a.site < b.site;
+    });
+    for(const site_total& t : totals){
+        if(t.n != 0){
+            printf("SITE: %s:%d: %zu active objects, %zu bytes\n",
+                   m61_site_file(t.site), m61_site_line(t.site), t.n, t.bytes);
+        }
+    }
+}
+
+
+/// m61_print_leak_report_scan(nthreads)
+///    Prints a leak report that classifies each active block as "leaked" or
+///    "reachable" by a conservative scan, then a summary.
+
+void m61_print_leak_report_scan(int nthreads) {
+    std::vector<m61_block_info> blocks;
+    m61_heap_walk([] (const m61_block_info* b, void* arg) {
+        if(b->state == M61_BLOCK_ACTIVE){
+            ((std::vector<m61_block_info>*) arg)->push_back(*b);
+        }
+        return 0;
+    }, &blocks);
+    std::unique_ptr<bool[]> reachable(new bool[blocks.size()]);
+    // handle-owned blocks are referred to by the handle table, not by
+    // pointers in the program
+    auto [handles_first, handles_last] = default_heap.handle_table();
+    m61_leak_scan(blocks.data(), blocks.size(), reachable.get(), nthreads,
+                  &default_heap, &default_heap + 1, handles_first, handles_last);
+
+    size_t nleaked = 0, leaked_size = 0, nreachable = 0, reachable_size = 0;
+    for(size_t i = 0; i != blocks.size(); ++i){
+        const m61_block_info& b = blocks[i];
+        printf("LEAK CHECK: %s:%d: %s object %p with size %zu\n",
+               b.file, b.line, reachable[i] ? "reachable" : "leaked", b.ptr, b.size);
+        if(reachable[i]){
+            ++nreachable;
+            reachable_size += b.size;
+        }
+        else{
+            ++nleaked;
+            leaked_size += b.size;
+        }
+    }
+    printf("LEAK SUMMARY: definitely leaked %zu objects (%zu bytes), "
+           "still reachable %zu objects (%zu bytes)\n",
+           nleaked, leaked_size, nreachable, reachable_size);
 }
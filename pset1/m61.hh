@@ -8,20 +8,57 @@
 #include <random>
 
 
+// Release builds (`make RELEASE=1`) do not track allocation sites, so call
+// sites pass constants instead of their file and line. Passing explicit
+// sites still compiles.
+#if M61_RELEASE
+# define M61_DEFAULT_FILE nullptr
+# define M61_DEFAULT_LINE 0
+#else
+# define M61_DEFAULT_FILE __builtin_FILE()
+# define M61_DEFAULT_LINE __builtin_LINE()
+#endif
+
 /// m61_malloc(sz, file, line)
 ///    Return a pointer to `sz` bytes of newly-allocated dynamic memory.
-void* m61_malloc(size_t sz, const char* file = __builtin_FILE(), int line = __builtin_LINE());
+void* m61_malloc(size_t sz, const char* file = M61_DEFAULT_FILE, int line = M61_DEFAULT_LINE);
 
 /// m61_free(ptr, file, line)
-///    Free the memory space pointed to by `ptr`.
-void m61_free(void* ptr, const char* file = __builtin_FILE(), int line = __builtin_LINE());
+///    Free the memory space pointed to by `ptr`. May be called from any
+///    thread: frees from threads other than the allocating one are queued
+///    without locking and reclaimed on the next allocation.
+void m61_free(void* ptr, const char* file = M61_DEFAULT_FILE, int line = M61_DEFAULT_LINE);
 
 /// m61_calloc(count, sz, file, line)
 ///    Return a pointer to newly-allocated dynamic memory big enough to
 ///    hold an array of `count` elements of `sz` bytes each. The memory
 ///    is initialized to zero.
-void* m61_calloc(size_t count, size_t sz, const char* file = __builtin_FILE(), int line = __builtin_LINE());
+void* m61_calloc(size_t count, size_t sz, const char* file = M61_DEFAULT_FILE, int line = M61_DEFAULT_LINE);
+
+/// m61_realloc(ptr, sz, file, line)
+///    Resize the allocation at `ptr` to `sz` bytes, moving it if needed,
+///    and return its new address. The first `sz` bytes of contents are
+///    kept; any new bytes are uninitialized. `m61_realloc(nullptr, sz)` is
+///    `m61_malloc(sz)`; `m61_realloc(ptr, 0)` frees `ptr` and returns
+///    `nullptr`. If out of memory, returns `nullptr` and leaves `ptr` alone.
+void* m61_realloc(void* ptr, size_t sz, const char* file = M61_DEFAULT_FILE, int line = M61_DEFAULT_LINE);
+
 
+/// m61_malloc_exclusive(sz, file, line)
+///    Like m61_malloc(), but the block starts and ends on cache-line
+///    (64-byte) boundaries, so no other block shares its cache lines and
+///    threads writing it do not contend with writers of neighbouring
+///    blocks. Costs up to a cache line of padding per block. Free it with
+///    m61_free().
+void* m61_malloc_exclusive(size_t sz, const char* file = M61_DEFAULT_FILE, int line = M61_DEFAULT_LINE);
+
+/// m61_set_exclusive(on)
+///    Turn exclusive placement on or off for the calling thread. While it
+///    is on, the thread's m61_malloc, m61_calloc and m61_realloc calls
+///    place blocks like m61_malloc_exclusive(), so objects it allocates for
+///    other threads to share need no hand padding. Returns the previous
+///    setting.
+bool m61_set_exclusive(bool on);
 
 /// m61_statistics
 ///    Structure tracking memory statistics.
@@ -34,8 +71,48 @@ struct m61_statistics {
     unsigned long long fail_size;       // # bytes in failed alloc attempts
     uintptr_t heap_min;                 // smallest allocated addr
     uintptr_t heap_max;                 // largest allocated addr
+    unsigned long long free_size;       // # bytes free (free blocks + unused heap)
+    unsigned long long nfree;           // # free blocks (unused heap counts as one)
+    unsigned long long largest_free;    // # bytes in largest free block
+    double fragmentation;               // external fragmentation: 1 - largest_free / free_size
+    unsigned long long padding_size;    // # bytes of alignment padding in active allocations
+    unsigned long long metadata_size;   // # bytes of allocator bookkeeping (estimated)
+    unsigned long long nfrontier;       // # allocations carved from the unused heap
+    unsigned long long nfreelist;       // # allocations taken from the free list
+    unsigned long long search_steps;    // # free blocks passed over by first-fit searches
+    unsigned long long fit_switches;    // # adaptive switches between first and best fit
 };
 
+/// m61_maintenance_start(interval_ms)
+///    Start a background thread that every `interval_ms` milliseconds
+///    reclaims cross-thread frees, coalesces free blocks, and returns the
+///    pages of large free blocks to the operating system. The first
+///    m61_malloc starts it if the `M61_MAINTENANCE` environment variable is
+///    set to an interval. Call from the allocating thread. While the thread
+///    runs, m61 calls take a lock that it only try-locks, so they wait at
+///    most for one bounded step. The child of a fork() runs without the
+///    thread; it may call m61_maintenance_start() to get its own.
+void m61_maintenance_start(unsigned interval_ms);
+
+/// m61_maintenance_stop()
+///    Stop the background maintenance thread, if running. Called
+///    automatically at exit.
+void m61_maintenance_stop();
+
+/// m61_stats_publish(interval_ms)
+///    Publish the statistics, size and lifetime histograms, and top
+///    allocation sites every `interval_ms` milliseconds (at most once
+///    per maintenance round) to the shared memory segment
+///    "/m61stats.PID", where `m61top PID` can watch them. Starts the
+///    maintenance thread if needed. Site totals are kept as blocks come
+///    and go, so publishing only copies them out in short locked chunks,
+///    then ranks and writes them with the heap unlocked. An interval of
+///    0 stops publishing and removes the segment, as does exit. The
+///    first m61_malloc starts publishing if the `M61_STATS` environment
+///    variable is set to an interval. Returns 0 on success, -1 if the
+///    segment could not be created.
+int m61_stats_publish(unsigned interval_ms);
+
 /// m61_get_statistics()
 ///    Return the current memory statistics.
 m61_statistics m61_get_statistics();
@@ -44,11 +121,146 @@ m61_statistics m61_get_statistics();
 ///    Print the current memory statistics.
 void m61_print_statistics();
 
+/// m61_set_heap_limits(soft, hard)
+///    Limit the heap bytes occupied by active allocations, counting
+///    alignment padding; 0 means no limit. An allocation that would exceed
+///    `hard` fails. One that would exceed `soft` first calls the pressure
+///    callbacks, but succeeds regardless if the hard limit allows.
+void m61_set_heap_limits(size_t soft, size_t hard);
+
+/// m61_pressure_callback, m61_add_pressure_callback(callback, ctx)
+///    Register `callback(want, ctx)` to be called when memory is short:
+///    when an allocation would cross the soft limit (`want` is the excess
+///    over it), and again when an allocation is about to fail (`want` is
+///    the block size). Callbacks run in registration order, on the
+///    allocating thread, and should free what they can with m61_free;
+///    the soft-limit pass stops once the allocation fits.
+typedef void (*m61_pressure_callback)(size_t want, void* ctx);
+void m61_add_pressure_callback(m61_pressure_callback callback, void* ctx);
+
+/// m61_remove_pressure_callback(callback, ctx)
+///    Unregister a callback. Returns 0 on success, -1 if it was not registered.
+int m61_remove_pressure_callback(m61_pressure_callback callback, void* ctx);
+
+/// m61_coalesce_step(budget)
+///    Merge adjacent free blocks, examining at most `budget` of them, and
+///    return the number of merges. Every malloc and free already does a
+///    little of this work; idle loops can call it to do more. Call it from
+///    the thread that allocates.
+size_t m61_coalesce_step(size_t budget);
+
+/// m61_handle, m61_handle_alloc(sz, file, line)
+///    Allocate a relocatable block of `sz` bytes and return its handle, or
+///    0 if out of memory. The block does not have a fixed address: get one
+///    with m61_pin(), which holds it in place until the matching
+///    m61_unpin(). Free the block with m61_handle_free(), never m61_free().
+///    Call the handle functions from the thread that allocates.
+typedef uint64_t m61_handle;
+m61_handle m61_handle_alloc(size_t sz, const char* file = M61_DEFAULT_FILE, int line = M61_DEFAULT_LINE);
+
+/// m61_handle_free(h, file, line)
+///    Free the block of handle `h`. Does nothing if `h == 0`.
+void m61_handle_free(m61_handle h, const char* file = M61_DEFAULT_FILE, int line = M61_DEFAULT_LINE);
+
+/// m61_pin(h), m61_unpin(h)
+///    Pin the block of handle `h` and return its address, or unpin it.
+///    Pins nest; the address stays valid until the last unpin.
+void* m61_pin(m61_handle h);
+void m61_unpin(m61_handle h);
+
+/// m61_compact()
+///    Slide every unpinned handle-owned block down into free space below
+///    it, merge the freed space, and return the heap pages above the
+///    highest remaining block to the operating system. Blocks allocated
+///    with m61_malloc() do not move. Returns the number of bytes returned.
+size_t m61_compact();
+
+/// m61_block_state, m61_block_info
+///    Description of one heap block, as reported by m61_heap_walk().
+///    In COMPACT builds, a block's footprint runs to the next block's
+///    payload, so it covers the header in between.
+enum m61_block_state {
+    M61_BLOCK_ACTIVE,                   // live allocation
+    M61_BLOCK_FREE,                     // freed, available for reuse
+    M61_BLOCK_UNUSED,                   // never-allocated tail of the heap
+    M61_BLOCK_METADATA                  // allocator bookkeeping (COMPACT slabs)
+};
+
+struct m61_block_info {
+    void* ptr;                          // first byte of the block
+    size_t size;                        // bytes requested (active) or available
+    size_t footprint;                   // bytes the block occupies
+    m61_block_state state;
+    const char* file;                   // allocation site (active blocks only)
+    int line;
+    uint32_t site;                      // its site ID (see m61site.hh), 0 if unknown
+};
+
+/// m61_heap_walk(callback, ctx)
+///    Call `callback(block, ctx)` for every heap block in address order.
+///    Each block starts where the previous one's footprint ends.
+///    If the callback returns nonzero, stop and return that value;
+///    otherwise return 0. The walk allocates no memory.
+int m61_heap_walk(int (*callback)(const m61_block_info* block, void* ctx), void* ctx);
+
+/// m61_heap_dump(path, flags)
+///    Write a snapshot of every heap block's address, size, state and
+///    allocation site to the binary file `path`, for offline analysis with
+///    `m61dump`. With M61_DUMP_CONTENTS, active blocks' contents are
+///    included. The snapshot is written by a forked child from its
+///    copy-on-write view of the heap, so the caller pauses only for the
+///    fork. Without M61_DUMP_ASYNC, waits for the child and returns 0 on
+///    success or -1 on error. With M61_DUMP_ASYNC, returns the child's
+///    process ID at once (the caller must reap it with waitpid()), or -1.
+enum {
+    M61_DUMP_CONTENTS = 1,
+    M61_DUMP_ASYNC = 2
+};
+int m61_heap_dump(const char* path, int flags = 0);
+
+/// m61_dump_stats_json(f)
+///    Write the current statistics, plus log2-bucketed histograms of
+///    request sizes and block lifetimes, to `f` as JSON.
+void m61_dump_stats_json(FILE* f);
+
+/// m61_profile_enable(on)
+///    Turn allocator profiling on or off. Profiling starts on if the
+///    `M61_PROFILE` environment variable is set to anything but 0. While
+///    on, each m61_malloc, m61_free, m61_calloc and m61_realloc, and each
+///    coalescing pass, records its duration in cycles in a per-thread
+///    log2 histogram.
+void m61_profile_enable(bool on);
+
+/// m61_dump_profile_json(f)
+///    Write the profile's histograms, summed over all threads, to `f` as
+///    JSON.
+void m61_dump_profile_json(FILE* f);
+
+/// m61_trace_flush()
+///    Write buffered records to the allocation trace named by the
+///    `M61_TRACE` environment variable, if any. Called automatically at exit.
+void m61_trace_flush();
+
 /// m61_print_leak_report()
 ///    Print a report of all currently-active allocated blocks of dynamic
 ///    memory.
 void m61_print_leak_report();
 
+/// m61_print_site_statistics()
+///    Print, for each allocation site with active blocks, their number and
+///    total size, largest total first. Sites are aggregated by site ID.
+void m61_print_site_statistics();
+
+/// m61_print_leak_report_scan(nthreads)
+///    Print a leak report that classifies every active block as "leaked"
+///    or "reachable", then a summary. A block is reachable if a pointer into
+///    it is found, conservatively, in the calling thread's stack or
+///    registers, the program's global data, or another reachable block.
+///    Other threads' stacks are not scanned and must not use the heap
+///    meanwhile. The heap scan runs on up to `nthreads` threads (0 means
+///    one per CPU).
+void m61_print_leak_report_scan(int nthreads = 0);
+
 
 /// This magic class lets standard C++ containers use your allocator
 /// instead of the system allocator.
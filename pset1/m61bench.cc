@@ -0,0 +1,406 @@
+#include "m61.hh"
+#include "m61heap.hh"
+#include "m61perf.hh"
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+// m61bench: allocator microbenchmarks, m61 against the system allocator.
+// Each (workload, allocator) pair runs in its own child process so that
+// heap state and peak RSS do not carry over between runs.
+
+struct m61_backend {
+    static constexpr const char* name = "m61";
+    template <typename T> using allocator = m61_allocator<T>;
+    static void* malloc(size_t sz) {
+        return m61_malloc(sz, "m61bench.cc", 0);
+    }
+    static void* calloc(size_t count, size_t sz) {
+        return m61_calloc(count, sz, "m61bench.cc", 0);
+    }
+    static void free(void* ptr) {
+        m61_free(ptr, "m61bench.cc", 0);
+    }
+};
+
+// a private m61_heap instantiated with `Policy`, created by run_one()
+template <typename Policy>
+struct heap_backend {
+    static inline m61_heap<Policy>* heap;
+
+    template <typename T>
+    struct allocator {
+        using value_type = T;
+        allocator() noexcept = default;
+        template <typename U> allocator(const allocator<U>&) noexcept {}
+        T* allocate(size_t n) {
+            return reinterpret_cast<T*>(heap->allocate(n * sizeof(T), "?", 0));
+        }
+        void deallocate(T* ptr, size_t) {
+            heap->free(ptr, "?", 0);
+        }
+        bool operator==(const allocator&) const {
+            return true;
+        }
+    };
+
+    static void* malloc(size_t sz) {
+        return heap->allocate(sz, "m61bench.cc", 0);
+    }
+    static void* calloc(size_t count, size_t sz) {
+        return heap->calloc(count, sz, "m61bench.cc", 0);
+    }
+    static void free(void* ptr) {
+        heap->free(ptr, "m61bench.cc", 0);
+    }
+};
+
+// size classes, best fit, no checks or statistics
+struct m61_fast_backend : heap_backend<m61_fast_policy> {
+    static constexpr const char* name = "m61fast";
+};
+
+// the same, with buddy placement
+struct m61_buddy_backend : heap_backend<m61_buddy_policy> {
+    static constexpr const char* name = "m61buddy";
+};
+
+// 8-byte in-band headers and slabs for tiny blocks
+struct m61_compact_backend : heap_backend<m61_compact_release_policy> {
+    static constexpr const char* name = "m61compact";
+};
+
+struct system_backend {
+    static constexpr const char* name = "system";
+    template <typename T> using allocator = std::allocator<T>;
+    static void* malloc(size_t sz) {
+        return ::malloc(sz);
+    }
+    static void* calloc(size_t count, size_t sz) {
+        return ::calloc(count, sz);
+    }
+    static void free(void* ptr) {
+        ::free(ptr);
+    }
+};
+
+struct bench_result {
+    m61_latencies lat;
+    unsigned long long live_bytes = 0;     // current requested bytes
+    unsigned long long peak_live = 0;      // peak requested bytes
+    unsigned long long nfail = 0;
+
+    void alloced(void* ptr, size_t sz) {
+        if (!ptr) {
+            ++nfail;
+            return;
+        }
+        live_bytes += sz;
+        peak_live = std::max(peak_live, live_bytes);
+    }
+};
+
+struct bench_block {
+    void* ptr;
+    size_t sz;
+};
+
+static constexpr size_t live_limit = 1000;
+
+
+// timed allocation helpers
+template <typename B>
+static bench_block bench_malloc(bench_result& r, size_t sz) {
+    uint64_t t0 = m61_now_ns();
+    void* ptr = B::malloc(sz);
+    r.lat.add(m61_now_ns() - t0);
+    r.alloced(ptr, sz);
+    if (ptr) {
+        memset(ptr, 0x61, std::min(sz, size_t(16)));
+    }
+    return {ptr, sz};
+}
+
+template <typename B>
+static void bench_free(bench_result& r, bench_block b) {
+    uint64_t t0 = m61_now_ns();
+    B::free(b.ptr);
+    r.lat.add(m61_now_ns() - t0);
+    if (b.ptr) {
+        r.live_bytes -= b.sz;
+    }
+}
+
+
+// workloads: each performs about `nops` timed operations
+
+template <typename B>
+static void fixed_churn(bench_result& r, size_t nops, std::default_random_engine& rng) {
+    std::vector<bench_block> live;
+    for (size_t i = 0; i < nops; ++i) {
+        if (live.size() == live_limit || (!live.empty() && uniform_int(0, 1, rng))) {
+            size_t j = uniform_int(size_t(0), live.size() - 1, rng);
+            bench_free<B>(r, live[j]);
+            live[j] = live.back();
+            live.pop_back();
+        } else {
+            live.push_back(bench_malloc<B>(r, 64));
+        }
+    }
+    for (auto& b : live) {
+        B::free(b.ptr);
+    }
+}
+
+template <typename B>
+static void random_sizes(bench_result& r, size_t nops, std::default_random_engine& rng) {
+    std::vector<bench_block> slots(live_limit, {nullptr, 0});
+    for (size_t i = 0; i < nops; ++i) {
+        size_t j = uniform_int(size_t(0), live_limit - 1, rng);
+        if (slots[j].ptr) {
+            bench_free<B>(r, slots[j]);
+            slots[j] = {nullptr, 0};
+        } else {
+            slots[j] = bench_malloc<B>(r, uniform_int(size_t(1), size_t(2000), rng));
+        }
+    }
+    for (auto& b : slots) {
+        B::free(b.ptr);
+    }
+}
+
+template <typename B>
+static void lifo(bench_result& r, size_t nops, std::default_random_engine& rng) {
+    std::vector<bench_block> stack;
+    size_t i = 0;
+    while (i < nops) {
+        size_t depth = uniform_int(size_t(1), live_limit, rng);
+        for (size_t j = 0; j != depth; ++j) {
+            stack.push_back(bench_malloc<B>(r, uniform_int(size_t(8), size_t(256), rng)));
+        }
+        while (!stack.empty()) {
+            bench_free<B>(r, stack.back());
+            stack.pop_back();
+        }
+        i += 2 * depth;
+    }
+}
+
+template <typename B>
+static void fifo(bench_result& r, size_t nops, std::default_random_engine& rng) {
+    std::deque<bench_block> queue;
+    for (size_t i = 0; i < nops; ++i) {
+        if (queue.size() == live_limit || (!queue.empty() && uniform_int(0, 2, rng) == 0)) {
+            bench_free<B>(r, queue.front());
+            queue.pop_front();
+        } else {
+            queue.push_back(bench_malloc<B>(r, uniform_int(size_t(8), size_t(256), rng)));
+        }
+    }
+    for (auto& b : queue) {
+        B::free(b.ptr);
+    }
+}
+
+template <typename B>
+static void container_nodes(bench_result& r, size_t nops, std::default_random_engine& rng) {
+    using value_type = std::pair<const int, long>;
+    std::map<int, long, std::less<int>, typename B::template allocator<value_type>> m;
+    for (size_t i = 0; i < nops; ++i) {
+        int key = uniform_int(0, int(4 * live_limit), rng);
+        uint64_t t0 = m61_now_ns();
+        if (m.size() < 2 * live_limit && uniform_int(0, 1, rng)) {
+            m.insert({key, long(i)});
+        } else {
+            m.erase(key);
+        }
+        r.lat.add(m61_now_ns() - t0);
+    }
+    r.peak_live = 2 * live_limit * (sizeof(value_type) + 4 * sizeof(void*));
+}
+
+template <typename B>
+static void calloc_heavy(bench_result& r, size_t nops, std::default_random_engine& rng) {
+    std::vector<bench_block> slots(live_limit / 4, {nullptr, 0});
+    for (size_t i = 0; i < nops; ++i) {
+        size_t j = uniform_int(size_t(0), slots.size() - 1, rng);
+        if (slots[j].ptr) {
+            bench_free<B>(r, slots[j]);
+            slots[j] = {nullptr, 0};
+        } else {
+            size_t count = uniform_int(size_t(1), size_t(64), rng);
+            size_t sz = uniform_int(size_t(1), size_t(128), rng);
+            uint64_t t0 = m61_now_ns();
+            void* ptr = B::calloc(count, sz);
+            r.lat.add(m61_now_ns() - t0);
+            r.alloced(ptr, count * sz);
+            slots[j] = {ptr, count * sz};
+        }
+    }
+    for (auto& b : slots) {
+        B::free(b.ptr);
+    }
+}
+
+// a cache of many tiny objects (1-24 bytes), replaced at random
+template <typename B>
+static void tiny_cache(bench_result& r, size_t nops, std::default_random_engine& rng) {
+    std::vector<bench_block> slots(50 * live_limit, {nullptr, 0});
+    for (size_t i = 0; i < nops; ++i) {
+        size_t j = i < slots.size() ? i : uniform_int(size_t(0), slots.size() - 1, rng);
+        if (slots[j].ptr) {
+            bench_free<B>(r, slots[j]);
+        }
+        slots[j] = bench_malloc<B>(r, uniform_int(size_t(1), size_t(24), rng));
+    }
+    for (auto& b : slots) {
+        B::free(b.ptr);
+    }
+}
+
+
+static const char* const backends[] = {
+    m61_backend::name, m61_fast_backend::name, m61_buddy_backend::name,
+    m61_compact_backend::name, system_backend::name
+};
+
+struct bench_workload {
+    const char* name;
+    // one entry per `backends` element
+    void (*run[5])(bench_result&, size_t, std::default_random_engine&);
+};
+
+#define BENCH_WORKLOAD(name) \
+    {#name, {name<m61_backend>, name<m61_fast_backend>, name<m61_buddy_backend>, \
+             name<m61_compact_backend>, name<system_backend>}}
+static const bench_workload workloads[] = {
+    BENCH_WORKLOAD(fixed_churn),
+    BENCH_WORKLOAD(random_sizes),
+    BENCH_WORKLOAD(lifo),
+    BENCH_WORKLOAD(fifo),
+    BENCH_WORKLOAD(container_nodes),
+    BENCH_WORKLOAD(calloc_heavy),
+    BENCH_WORKLOAD(tiny_cache)
+};
+
+static void run_one(const bench_workload& w, int bi,
+                    size_t nops, unsigned seed, bool json) {
+    const char* backend = backends[bi];
+    std::default_random_engine rng(seed);
+    bench_result r;
+    if (bi == 1) {
+        m61_fast_backend::heap = new m61_heap<m61_fast_policy>;
+    } else if (bi == 2) {
+        m61_buddy_backend::heap = new m61_heap<m61_buddy_policy>;
+    } else if (bi == 3) {
+        m61_compact_backend::heap = new m61_heap<m61_compact_release_policy>;
+    }
+    size_t rss0 = m61_peak_rss_kb();
+    uint64_t t0 = m61_now_ns();
+    w.run[bi](r, nops, rng);
+    double elapsed = (m61_now_ns() - t0) / 1e9;
+    size_t rss = m61_peak_rss_kb() - rss0;
+    double opsec = r.lat.total() ? r.lat.count() / (r.lat.total() / 1e9) : 0;
+    // peak RSS growth not explained by peak live payload, per payload byte.
+    // This is process-wide, so it counts the benchmark's own memory and
+    // page granularity as well as allocator metadata
+    double rss_overhead = r.peak_live
+        ? (double(rss) * 1024 - double(r.peak_live)) / double(r.peak_live) : 0;
+
+    if (json) {
+        printf("{\"workload\":\"%s\",\"allocator\":\"%s\",\"seed\":%u,\"ops\":%zu,"
+               "\"elapsed_s\":%.6f,\"ops_per_sec\":%.0f,\"p50_ns\":%" PRIu64
+               ",\"p99_ns\":%" PRIu64 ",\"p999_ns\":%" PRIu64 ",\"peak_rss_kb\":%zu,"
+               "\"peak_live_bytes\":%llu,\"rss_overhead_ratio\":%.3f,\"nfail\":%llu}\n",
+               w.name, backend, seed, r.lat.count(), elapsed, opsec,
+               r.lat.percentile(50), r.lat.percentile(99), r.lat.percentile(99.9),
+               rss, r.peak_live, rss_overhead, r.nfail);
+    } else {
+        printf("%-16s %-10s %10zu %12.0f %7" PRIu64 " %7" PRIu64 " %7" PRIu64
+               " %9zu %9.3f %6llu\n",
+               w.name, backend, r.lat.count(), opsec, r.lat.percentile(50),
+               r.lat.percentile(99), r.lat.percentile(99.9), rss, rss_overhead, r.nfail);
+    }
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: m61bench [-j] [-n OPS] [-s SEED] [-a m61|m61fast|m61buddy|m61compact|system] [WORKLOAD...]\n");
+    fprintf(stderr, "Workloads:");
+    for (auto& w : workloads) {
+        fprintf(stderr, " %s", w.name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    size_t nops = 200000;
+    unsigned seed = 61;
+    bool json = false;
+    const char* only_backend = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "jn:s:a:")) != -1) {
+        if (opt == 'j') {
+            json = true;
+        } else if (opt == 'n') {
+            nops = strtoul(optarg, nullptr, 0);
+        } else if (opt == 's') {
+            seed = strtoul(optarg, nullptr, 0);
+        } else if (opt == 'a') {
+            only_backend = optarg;
+        } else {
+            usage();
+        }
+    }
+    if (only_backend) {
+        bool found = false;
+        for (auto backend : backends) {
+            found = found || strcmp(backend, only_backend) == 0;
+        }
+        if (!found) {
+            usage();
+        }
+    }
+    for (int i = optind; i < argc; ++i) {
+        bool found = false;
+        for (auto& w : workloads) {
+            found = found || strcmp(w.name, argv[i]) == 0;
+        }
+        if (!found) {
+            usage();
+        }
+    }
+
+    if (!json) {
+        printf("%-16s %-10s %10s %12s %7s %7s %7s %9s %9s %6s\n",
+               "workload", "alloc", "ops", "ops/sec", "p50ns", "p99ns", "p999ns",
+               "rss_kb", "rss_ovhd", "nfail");
+    }
+    for (auto& w : workloads) {
+        bool selected = optind == argc;
+        for (int i = optind; i < argc; ++i) {
+            selected = selected || strcmp(w.name, argv[i]) == 0;
+        }
+        for (int bi = 0; bi != (int) std::size(backends); ++bi) {
+            const char* backend = backends[bi];
+            if (!selected || (only_backend && strcmp(only_backend, backend) != 0)) {
+                continue;
+            }
+            fflush(stdout);
+            pid_t p = fork();
+            if (p == 0) {
+                run_one(w, bi, nops, seed, json);
+                fflush(stdout);
+                _exit(0);
+            }
+            int status;
+            waitpid(p, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "m61bench: %s/%s crashed\n", w.name, backend);
+            }
+        }
+    }
+}
@@ -0,0 +1,202 @@
+#include "m61heapdump.hh"
+#include "hexdump.hh"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+// m61dump: analyze a heap dump written by m61_heap_dump(). Prints a summary
+// and, on request, the top allocation sites, the distribution of block
+// sizes, a map of the heap, and the contents of active blocks.
+
+static void usage() {
+    fprintf(stderr, "Usage: m61dump [-t TOPSITES] [-s] [-f] [-w WIDTH] [-x] DUMP\n");
+    exit(1);
+}
+
+static void print_summary(const char* path, const m61_dump& d) {
+    size_t nactive = 0, active_size = 0, active_footprint = 0;
+    size_t nfree = 0, free_size = 0, largest_free = 0;
+    for (auto& b : d.blocks) {
+        if (b.kind == M61_DUMP_ACTIVE) {
+            ++nactive;
+            active_size += b.size;
+            active_footprint += b.footprint;
+        } else if (b.kind != M61_DUMP_METADATA) {
+            // as in m61_statistics, the unused tail counts as a free block
+            ++nfree;
+            free_size += b.size;
+            largest_free = std::max(largest_free, (size_t) b.size);
+        }
+    }
+    time_t t = d.header.time;
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    printf("dump:       %s (pid %u, %s%s)\n", path, d.header.pid, when,
+           d.header.flags & M61_DUMP_CONTENTS ? ", with contents" : "");
+    printf("active:     %zu blocks, %zu bytes (%zu bytes footprint)\n",
+           nactive, active_size, active_footprint);
+    printf("free:       %zu blocks, %zu bytes, largest %zu bytes\n",
+           nfree, free_size, largest_free);
+    printf("fragmentation: %.3f\n",
+           free_size ? 1 - (double) largest_free / free_size : 0.0);
+}
+
+static void print_top_sites(const m61_dump& d, size_t n) {
+    struct site_total {
+        uint32_t site;
+        size_t n;
+        size_t bytes;
+    };
+    std::vector<site_total> totals(d.sites.size());
+    for (size_t i = 0; i != totals.size(); ++i) {
+        totals[i] = {(uint32_t) i, 0, 0};
+    }
+    for (auto& b : d.blocks) {
+        if (b.kind == M61_DUMP_ACTIVE) {
+            site_total& t = totals[b.site < totals.size() ? b.site : 0];
+            ++t.n;
+            t.bytes += b.size;
+        }
+    }
+    std::sort(totals.begin(), totals.end(), [] (const site_total& a, const site_total& b) {
+        return a.bytes != b.bytes ? a.bytes > b.bytes : a.site < b.site;
+    });
+    printf("\ntop sites by active bytes:\n");
+    for (size_t i = 0; i != std::min(n, totals.size()) && totals[i].n != 0; ++i) {
+        const m61_dump::site& s = d.sites[totals[i].site];
+        printf("%12zu bytes %8zu objects   %s:%d\n",
+               totals[i].bytes, totals[i].n, s.file.c_str(), s.line);
+    }
+}
+
+static void print_size_distribution(const m61_dump& d) {
+    // active blocks by log2 of size: bucket b holds sizes [2^(b-1), 2^b)
+    size_t count[65] = {}, bytes[65] = {}, maxcount = 0;
+    for (auto& b : d.blocks) {
+        if (b.kind == M61_DUMP_ACTIVE) {
+            int bucket = b.size ? 64 - __builtin_clzll(b.size) : 0;
+            ++count[bucket];
+            bytes[bucket] += b.size;
+            maxcount = std::max(maxcount, count[bucket]);
+        }
+    }
+    printf("\nactive block sizes:\n");
+    for (int bucket = 0; bucket != 65; ++bucket) {
+        if (count[bucket] != 0) {
+            unsigned long long lo = bucket ? 1ULL << (bucket - 1) : 0;
+            unsigned long long hi = bucket ? (lo << 1) - 1 : 0;
+            int bar = (int) ((count[bucket] * 40 + maxcount - 1) / maxcount);
+            printf("%10llu-%-10llu %8zu blocks %12zu bytes  %.*s\n",
+                   lo, hi, count[bucket], bytes[bucket], bar,
+                   "########################################");
+        }
+    }
+}
+
+// one character per `cell` bytes of the heap, up to the unused tail:
+// '#' active, '.' free, '+' both, ' ' neither (headers and slab metadata)
+static void print_map(const m61_dump& d, size_t width) {
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (auto& b : d.blocks) {
+        if (b.kind != M61_DUMP_UNUSED) {
+            lo = std::min(lo, b.addr);
+            hi = std::max(hi, b.addr + b.footprint);
+        }
+    }
+    if (lo >= hi) {
+        printf("\nheap map: empty\n");
+        return;
+    }
+    uint64_t cell = 16;
+    while ((hi - lo + cell - 1) / cell > 16 * width) {
+        cell *= 2;
+    }
+    size_t ncells = (hi - lo + cell - 1) / cell;
+    std::vector<uint64_t> active(ncells, 0), freed(ncells, 0);
+    for (auto& b : d.blocks) {
+        if (b.kind == M61_DUMP_UNUSED || b.kind == M61_DUMP_METADATA) {
+            continue;
+        }
+        auto& into = b.kind == M61_DUMP_ACTIVE ? active : freed;
+        uint64_t a = b.addr, end = b.addr + b.footprint;
+        while (a < end) {
+            size_t c = (a - lo) / cell;
+            uint64_t cell_end = std::min(lo + (c + 1) * cell, end);
+            into[c] += cell_end - a;
+            a = cell_end;
+        }
+    }
+    printf("\nheap map: %zu bytes per character ('#' active, '.' free, '+' both)\n",
+           (size_t) cell);
+    for (size_t row = 0; row < ncells; row += width) {
+        printf("%#14" PRIx64 " |", lo + row * cell);
+        for (size_t c = row; c != std::min(row + width, ncells); ++c) {
+            putchar(active[c] && freed[c] ? '+' : active[c] ? '#' : freed[c] ? '.' : ' ');
+        }
+        printf("|\n");
+    }
+}
+
+static void print_contents(const m61_dump& d) {
+    if (!(d.header.flags & M61_DUMP_CONTENTS)) {
+        fprintf(stderr, "m61dump: dump has no block contents\n");
+        return;
+    }
+    for (auto& b : d.blocks) {
+        if (const char* data = d.contents_of(b)) {
+            const m61_dump::site& s = d.site_of(b);
+            printf("\nblock %#" PRIx64 ": %" PRIu64 " bytes, allocated at %s:%d\n",
+                   b.addr, b.size, s.file.c_str(), s.line);
+            fhexdump_at(stdout, b.addr, data, b.size);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t topsites = 0, width = 64;
+    bool sizes = false, map = false, contents = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:sfw:x")) != -1) {
+        switch (opt) {
+        case 't':
+            topsites = strtoul(optarg, nullptr, 0);
+            break;
+        case 's':
+            sizes = true;
+            break;
+        case 'f':
+            map = true;
+            break;
+        case 'w':
+            width = strtoul(optarg, nullptr, 0);
+            break;
+        case 'x':
+            contents = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind + 1 != argc || width == 0) {
+        usage();
+    }
+
+    m61_dump d;
+    if (!d.load(argv[optind])) {
+        fprintf(stderr, "m61dump: %s\n", d.error.c_str());
+        exit(1);
+    }
+    print_summary(argv[optind], d);
+    if (topsites) {
+        print_top_sites(d, topsites);
+    }
+    if (sizes) {
+        print_size_distribution(d);
+    }
+    if (map) {
+        print_map(d, width);
+    }
+    if (contents) {
+        print_contents(d);
+    }
+}
@@ -0,0 +1,1861 @@
+#ifndef M61HEAP_HH
+#define M61HEAP_HH 1
+#include "m61.hh"
+#include "m61memops.hh"
+#include "m61prof.hh"
+#include "m61site.hh"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <cstring>
+#include <map>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// m61_heap<Policy>: the allocator behind the m61_* functions, with its
+// layout and checking decisions fixed at compile time by `Policy`.
+// m61.cc instantiates m61_heap<m61_default_policy> (m61_release_policy in
+// release builds, the compact policies in compact ones) for the C-style
+// API; other instantiations each own a separate buffer.
+
+
+/// m61_fit
+///    How a free block is chosen when the frontier cannot serve a request.
+enum class m61_fit {
+    first,      // lowest-addressed free block that fits
+    best,       // smallest free block that fits
+    buddy       // power-of-two blocks, split in halves and merged with
+                // their buddies on free (heap_size must be a power of two)
+};
+
+/// m61_default_policy
+///    Policy used by m61_malloc() and friends in debug builds. Other
+///    policies derive from it and override members. A policy provides:
+///      heap_size      bytes of virtual memory the heap reserves
+///      alignment      alignment of every block (a power of two)
+///      size_classes   sorted footprints small requests round up to; an
+///                     empty table rounds every request to `alignment`
+///      fit            free-block selection strategy
+///      adaptive_fit   with first fit, switch each log2 range of block
+///                     sizes to best fit while its first-fit searches run
+///                     long, probing first fit again now and then
+///      coalesce_budget  free blocks each malloc and free examines for
+///                     merging (the full pass runs only before failing);
+///                     0 merges each freed block with its neighbours at
+///                     once and leaves malloc alone
+///      debug_checks   diagnose invalid and double frees
+///      site_tracking  record each block's allocation file and line
+///      statistics     maintain m61_statistics counters
+///      histogram_sampling  record 1 in N operations in the size and
+///                     lifetime histograms (0 disables them)
+///      compact_headers  keep each block's size, state and site in an
+///                     8-byte header before it instead of a side map, and
+///                     serve requests of at most 16 bytes from headerless
+///                     slabs (needs 16-byte alignment and first or best
+///                     fit; blocks have no birth, so no lifetime histogram)
+struct m61_default_policy {
+    static constexpr size_t heap_size = 8 << 20;
+    static constexpr size_t alignment = 16;
+    static constexpr std::array<size_t, 0> size_classes = {};
+    static constexpr m61_fit fit = m61_fit::first;
+    static constexpr bool adaptive_fit = true;
+    static constexpr size_t coalesce_budget = 4;
+    static constexpr bool debug_checks = true;
+    static constexpr bool site_tracking = true;
+    static constexpr bool statistics = true;
+    static constexpr unsigned histogram_sampling = 1;
+    static constexpr bool compact_headers = false;
+};
+
+/// m61_release_policy
+///    Policy used by m61_malloc() and friends in release builds
+///    (`make RELEASE=1`): no site tracking or invalid-free diagnosis,
+///    sampled histograms, and coalescing on free only. Counters stay exact.
+struct m61_release_policy : m61_default_policy {
+    static constexpr size_t coalesce_budget = 0;
+    static constexpr bool debug_checks = false;
+    static constexpr bool site_tracking = false;
+    static constexpr unsigned histogram_sampling = 64;
+};
+
+/// m61_fast_policy
+///    Power-of-two-ish size classes, best fit, and no checks or statistics.
+struct m61_fast_policy : m61_release_policy {
+    static constexpr std::array<size_t, 10> size_classes = {
+        16, 32, 48, 64, 96, 128, 256, 512, 1024, 2048
+    };
+    static constexpr m61_fit fit = m61_fit::best;
+    static constexpr bool statistics = false;
+    static constexpr unsigned histogram_sampling = 0;
+};
+
+
+/// m61_buddy_policy
+///    m61_fast_policy with buddy placement.
+struct m61_buddy_policy : m61_fast_policy {
+    static constexpr m61_fit fit = m61_fit::buddy;
+};
+
+/// m61_compact_policy
+///    m61_default_policy with compact headers. Used by m61_malloc() and
+///    friends in `make COMPACT=1` builds. Its debug checks confirm each
+///    header against a side map, so a forged header cannot pass for a block.
+struct m61_compact_policy : m61_default_policy {
+    static constexpr bool compact_headers = true;
+};
+
+/// m61_compact_release_policy
+///    m61_release_policy with compact headers: the least memory per block,
+///    with allocation sites still tracked. Used by m61_malloc() and friends
+///    in `make COMPACT=1 RELEASE=1` builds.
+struct m61_compact_release_policy : m61_release_policy {
+    static constexpr bool site_tracking = true;
+    static constexpr bool compact_headers = true;
+};
+
+
+/// m61_size_classes<Policy>
+///    Maps request sizes to block footprints. Requests up to the largest
+///    class are one lookup in a table built at compile time.
+template <typename Policy>
+struct m61_size_classes {
+    static constexpr size_t align = Policy::alignment;
+    static constexpr size_t nclasses = Policy::size_classes.size();
+    static constexpr size_t max_class = nclasses ? Policy::size_classes[nclasses - 1] : 0;
+
+    static_assert(align >= sizeof(void*) && (align & (align - 1)) == 0,
+                  "alignment must be a power of two that can hold a pointer");
+    static constexpr bool valid_classes() {
+        for (size_t i = 0; i != nclasses; ++i) {
+            if (Policy::size_classes[i] == 0 || Policy::size_classes[i] % align != 0
+                || (i != 0 && Policy::size_classes[i] <= Policy::size_classes[i - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(valid_classes(), "size classes must be increasing multiples of alignment");
+
+    // table[i] = footprint of requests of ((i - 1) * align, i * align] bytes
+    static constexpr std::array<size_t, max_class / align + 1> table = [] {
+        std::array<size_t, max_class / align + 1> t{};
+        size_t c = 0;
+        for (size_t i = 0; i != t.size() && nclasses != 0; ++i) {
+            while (Policy::size_classes[c] < i * align) {
+                ++c;
+            }
+            t[i] = Policy::size_classes[c];
+        }
+        return t;
+    }();
+
+    // bytes a block of `sz` bytes reserves; zero-sized blocks still get
+    // their own slot
+    static constexpr size_t footprint(size_t sz) {
+        size_t units = (sz + (sz == 0) + align - 1) / align;
+        if constexpr (nclasses != 0) {
+            if (sz <= max_class) {
+                return table[units];
+            }
+        }
+        return units * align;
+    }
+};
+
+
+// allocation site of a block, when the policy tracks sites
+struct m61_site {
+    uint32_t site;      // m61_site_intern() ID
+};
+struct m61_no_site {
+};
+
+// bookkeeping for one live allocation
+template <bool Sites>
+struct m61_block : std::conditional_t<Sites, m61_site, m61_no_site> {
+    size_t size;        // bytes requested
+    size_t footprint;   // bytes reserved, including alignment padding
+    unsigned long long birth;   // allocation epoch at which the block was made
+};
+
+// Exclusive blocks (see m61_malloc_exclusive()) start on a cache line and
+// end where one ends, so no other block shares their lines
+static constexpr size_t m61_cache_line = 64;
+
+// link written into a block freed by a thread other than the buffer's owner;
+// every block spans at least `alignment` bytes so there is always room for it
+struct m61_remote_free {
+    m61_remote_free* next;
+};
+
+// in-band header of a block in a compact-header heap, just before its payload
+struct m61_compact_header {
+    uint32_t size;          // bytes requested
+    uint32_t state : 8;     // m61_compact_active, m61_compact_exclusive,
+                            // or m61_compact_freed
+    uint32_t site : 24;     // allocation site ID, 0 if unknown
+};
+static_assert(sizeof(m61_compact_header) == 8);
+static constexpr uint32_t m61_compact_active = 0xA5;
+static constexpr uint32_t m61_compact_exclusive = 0xC3;     // active, own cache lines
+static constexpr uint32_t m61_compact_freed = 0x5A;
+static_assert(m61_site_capacity <= (1U << 24), "site IDs must fit compact headers");
+
+// a page of 16-byte slots for tiny blocks in a compact-header heap. The slab
+// is a heap block whose payload starts on a page boundary, so a slot finds
+// its slab by masking its address. Slots carry no header: a bit in `used`
+// marks them live and `info` holds their requested sizes and sites.
+struct m61_slab {
+    static constexpr size_t page = 4096;
+    static constexpr size_t slot = 16;
+    static constexpr size_t nslots = 201;
+    // bytes the slab takes in its heap, compact header included
+    static constexpr size_t footprint = page;
+
+    m61_slab* prev;         // list of slabs with free slots
+    m61_slab* next;
+    uint64_t used[(nslots + 63) / 64];
+    uint32_t nfree;
+    struct {
+        uint32_t size : 8;      // bytes requested
+        uint32_t site : 24;     // allocation site ID, 0 if unknown
+    } info[nslots];
+
+    static m61_slab* of(const void* ptr) {
+        return (m61_slab*) ((uintptr_t) ptr & ~(page - 1));
+    }
+    bool live(size_t i) const {
+        return (used[i / 64] >> (i % 64)) & 1;
+    }
+    inline char* slot_ptr(size_t i);
+    // index of the slot at `ptr`, or nslots if `ptr` is not a slot
+    inline size_t slot_index(const void* ptr);
+};
+
+// slots start after the slab's bookkeeping; the slab's compact header sits
+// just below the page and the page's last bytes hold the next block's header
+static constexpr size_t m61_slab_first_slot = (sizeof(m61_slab) + m61_slab::slot - 1)
+    & ~(m61_slab::slot - 1);
+static_assert(m61_slab_first_slot + m61_slab::nslots * m61_slab::slot
+              <= m61_slab::page - sizeof(m61_compact_header));
+
+inline char* m61_slab::slot_ptr(size_t i) {
+    return (char*) this + m61_slab_first_slot + i * slot;
+}
+
+inline size_t m61_slab::slot_index(const void* ptr) {
+    size_t off = (const char*) ptr - (const char*) this;
+    if (off < m61_slab_first_slot || off % slot != 0) {
+        return nslots;
+    }
+    return std::min((off - m61_slab_first_slot) / slot, nslots);
+}
+
+struct m61_memory_buffer {
+    char* buffer; // pointer reference to first byte in buffer
+    size_t pos = 0;
+    size_t size;
+
+    // thread that allocates from (and owns the bookkeeping of) this buffer:
+    // the first to allocate, which need not be the one that constructed it
+    std::atomic<std::thread::id> owner;
+    // lock-free MPSC stack of cross-thread frees: other threads push with a
+    // single CAS, the owner takes the whole batch with one exchange
+    std::atomic<m61_remote_free*> remote_frees = nullptr;
+
+    //constructor: anonymous private memory
+    m61_memory_buffer(size_t sz);
+    //deconstructor
+    ~m61_memory_buffer();
+
+    bool owned() const {
+        return owner.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+    // makes the calling thread the owner if there is none yet
+    void claim() {
+        if(owner.load(std::memory_order_relaxed) == std::thread::id()){
+            owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        }
+    }
+};
+
+inline m61_memory_buffer::m61_memory_buffer(size_t sz)
+    : size(sz) {
+    /*
+    mmap() function asks the kernel to create new virtual memory area,
+    preferably one that starts at address "nullptr" and map to a contiguous object
+    chunk of the object specified by file descriptor fd = -1 to the new area
+    */
+    void* buf = mmap(nullptr,    // Place the buffer at a random address
+        this->size,              // Buffer/Virtual Memory is `size` bytes big
+        PROT_READ | PROT_WRITE,  // We want to read and write the buffer
+        MAP_ANON | MAP_PRIVATE, -1, 0);
+                                 // We want memory freshly allocated by the OS
+    assert(buf != MAP_FAILED);
+    M61_PROBE2(arena_map, buf, sz);
+
+    //pointer to virtual memory returned from mmap() persists in buffer attribute of "m61_memory_buffer" struct
+    this->buffer = (char*) buf;
+}
+
+inline m61_memory_buffer::~m61_memory_buffer() {
+    //deletes the area starting at virtual address "this.buffer" and consisting of next "size" bytes
+    munmap(this->buffer, this->size);
+}
+
+
+// approximate heap cost of one std::map/std::set node holding `T`
+// (red-black links and color plus the value, rounded to malloc granularity)
+template <typename T>
+constexpr size_t m61_node_size = (4 * sizeof(void*) + sizeof(T) + 15) & ~size_t(15);
+
+// active blocks and bytes of one allocation site
+struct m61_site_total {
+    unsigned long long nactive = 0;
+    unsigned long long bytes = 0;
+};
+
+
+template <typename Policy>
+class m61_heap {
+public:
+    using policy = Policy;
+    using classes = m61_size_classes<Policy>;
+    using block = m61_block<Policy::site_tracking>;
+
+    m61_heap();
+    m61_heap(const m61_heap&) = delete;
+    m61_heap& operator=(const m61_heap&) = delete;
+
+    // with `exclusive`, the block gets cache lines of its own
+    void* allocate(size_t sz, const char* file, int line, bool exclusive = false);
+    void* calloc(size_t count, size_t sz, const char* file, int line, bool exclusive = false);
+    void* reallocate(void* ptr, size_t sz, const char* file, int line, bool exclusive = false);
+    void free(void* ptr, const char* file, int line);
+    // queues `ptr` for its owner and returns true if the caller is not the
+    // owner; touches no bookkeeping, so callers need not lock the heap
+    bool free_remote(void* ptr, const char* file, int line);
+
+    m61_statistics statistics();
+    // without `drain`, queued remote frees still show as active, but the
+    // walk allocates nothing (as a forked child needs)
+    int walk(int (*callback)(const m61_block_info* block, void* ctx), void* ctx,
+             bool drain = true);
+    const unsigned long long* size_histogram() const {
+        return size_hist;
+    }
+    const unsigned long long* lifetime_histogram() const {
+        return lifetime_hist;
+    }
+    bool contains(const void* ptr) const {
+        return (uintptr_t) ptr - (uintptr_t) buf.buffer < buf.size;
+    }
+
+    void set_limits(size_t soft, size_t hard) {
+        soft_limit = soft;
+        hard_limit = hard;
+    }
+    void add_pressure_callback(m61_pressure_callback callback, void* ctx) {
+        pressure_callbacks.push_back({callback, ctx});
+    }
+    bool remove_pressure_callback(m61_pressure_callback callback, void* ctx);
+    size_t coalesce_step(size_t budget);
+
+    // background maintenance; see maintain()
+    using trim_range = std::pair<void*, size_t>;
+    size_t maintain(size_t budget, size_t min_size, trim_range* out, size_t max);
+    void return_trimmed(const trim_range* blocks, size_t n);
+
+    // relocatable blocks named by handles (nonzero); see compact()
+    uint64_t handle_allocate(size_t sz, const char* file, int line);
+    void handle_free(uint64_t h, const char* file, int line);
+    void* pin(uint64_t h);
+    void unpin(uint64_t h);
+    size_t compact();
+    // the handle table, which refers to handle-owned blocks for the program
+    std::pair<const void*, const void*> handle_table() const {
+        return {handles.data(), handles.data() + handles.size()};
+    }
+    // active blocks and bytes by site ID, kept as blocks come and go when
+    // the policy tracks sites and statistics; IDs past the end have none
+    const std::vector<m61_site_total>& site_totals() const {
+        return site_counts;
+    }
+
+private:
+    using freemap_iter = std::map<void*, size_t>::iterator;
+
+    m61_memory_buffer buf;
+
+    // ordered map for tracking: {pointers to live allocations => their bookkeeping}
+    std::map<void*, block> active_ptrs;
+    // ordered map for tracking: {pointers to free allocations => bytes of freed memory}
+    std::map<void*, size_t> free_ptrs;
+    // every free_ptrs block by (size, address): largest block and best fit
+    // are O(log n) lookups
+    std::set<std::pair<size_t, void*>> free_sizes;
+    // bytes in free_ptrs blocks; the unused frontier is added on read
+    unsigned long long free_list_size = 0;
+    // incremental coalescing resumes at the first free block at or after this
+    void* coalesce_cursor = nullptr;
+    // free blocks whose pages were returned to the OS, with their size then
+    std::map<void*, size_t> trimmed_ptrs;
+    // free blocks maintain() has checked out and not yet returned, in
+    // address order; they still count as free
+    std::vector<trim_range> checked_out;
+
+    // handle `h` is handles[h - 1]; a free entry has a null `ptr`
+    struct handle_entry {
+        void* ptr;
+        unsigned pins;
+    };
+    std::vector<handle_entry> handles;
+    std::vector<size_t> free_handles;       // indexes of free entries
+    // every handle-owned block => its handles index, in address order
+    std::map<void*, size_t> handle_blocks;
+    // highest frontier since compact() last returned pages to the OS
+    size_t high_water = 0;
+
+    // COMPACT HEADERS (P::compact_headers): each block starts with an
+    // m61_compact_header, or is a slot in a slab. active_ptrs holds the
+    // headered blocks only with debug checks, to vouch for their headers
+    static constexpr size_t header_size = Policy::compact_headers ? sizeof(m61_compact_header) : 0;
+    m61_slab* partial_slabs = nullptr;      // slabs with a free slot
+    size_t nslabs = 0;
+    size_t nheadered = 0;                   // active blocks with a header
+    std::bitset<Policy::heap_size / m61_slab::page> slab_pages;
+
+    m61_statistics alloc_stats = {};
+    std::vector<m61_site_total> site_counts;    // see site_totals()
+    unsigned long long size_hist[m61_hist_buckets] = {};
+    unsigned long long lifetime_hist[m61_hist_buckets] = {};
+    unsigned long long alloc_epoch = 0;
+    unsigned histogram_tick = 0;
+
+    // ADAPTIVE FIT (P::adaptive_fit): each log2 range of footprints keeps
+    // the free-list allocations and first-fit search steps of its current
+    // window. A range whose searches average more than `fit_long_search`
+    // steps uses best fit for `hold` windows, then probes first fit again;
+    // each failed probe doubles the next hold.
+    static constexpr unsigned fit_window = 64;
+    static constexpr unsigned fit_long_search = 16;
+    static constexpr unsigned fit_min_hold = 4;
+    static constexpr unsigned fit_max_hold = 256;
+    struct fit_range {
+        unsigned allocs = 0;
+        unsigned long long steps = 0;
+        bool best = false;
+        unsigned hold = 0;              // best-fit windows left
+        unsigned next_hold = fit_min_hold;
+    };
+    std::array<fit_range, m61_hist_buckets> fit_ranges;
+
+    // bytes in active block footprints, and the limits on it (0 = none)
+    size_t in_use = 0;
+    size_t soft_limit = 0;
+    size_t hard_limit = 0;
+    std::vector<std::pair<m61_pressure_callback, void*>> pressure_callbacks;
+    bool in_pressure = false;   // callbacks are running
+
+    bool sample_histogram();
+    static constexpr size_t block_footprint(size_t sz);
+    static constexpr size_t exclusive_footprint(size_t sz);
+    static constexpr size_t footprint_for(size_t sz, bool exclusive) {
+        return exclusive ? exclusive_footprint(sz) : block_footprint(sz);
+    }
+    // bytes from `a` to the next block start whose payload is line-aligned
+    static size_t line_gap(const char* a) {
+        return -(uintptr_t) (a + header_size) & (m61_cache_line - 1);
+    }
+    bool over_limit(size_t limit, size_t footprint) const {
+        return limit != 0 && (footprint > limit || in_use > limit - footprint);
+    }
+    bool relieve_pressure(size_t footprint, size_t limit);
+    void* m61_find_free_space(size_t sz, const char* file, int line, bool exclusive);
+    void* take_free_block(freemap_iter it, size_t sz, size_t footprint, const char* file, int line,
+                          bool exclusive = false);
+    void* reserve(void* ptr, size_t sz, size_t footprint, const char* file, int line,
+                  bool exclusive = false);
+    freemap_iter fit_free_block(size_t footprint);
+    freemap_iter fit_exclusive_block(size_t footprint);
+    freemap_iter best_fit(size_t footprint);
+    void adapt_fit(fit_range& r, size_t steps);
+    void free_insert(void* ptr, size_t sz);
+    void free_erase(freemap_iter it);
+    bool can_coalesce_up(freemap_iter it);
+    void merge_next(freemap_iter it);
+    void coalesce_up(freemap_iter it);
+    void coalesce_freed(void* ptr);
+    void consolidate_all_free_memory_regions(freemap_iter it);
+    void* buddy_allocate(size_t sz, size_t footprint, const char* file, int line);
+    void buddy_release(void* ptr, size_t footprint);
+    void free_local(void* ptr, const char* file, int line);
+    void drain_remote_frees();
+    void invalid_free(void* ptr, const char* file, int line);
+    bool retreat_frontier();
+    handle_entry* find_handle(uint64_t h, const char* file, int line);
+    void check_unowned(void* ptr, const char* file, int line);
+    void* relocate(void* ptr);
+
+    bool in_slab(const void* ptr) const {
+        return contains(ptr) && slab_pages[((const char*) ptr - buf.buffer) / m61_slab::page];
+    }
+    uint32_t site_id(const char* file, int line);
+    void count_site(uint32_t site, long long n, long long bytes);
+    char* slab_block();
+    void* slab_allocate(size_t sz, uint32_t site);
+    void slab_release(m61_slab* s, size_t i);
+    m61_compact_header* compact_header(void* ptr);
+    static constexpr size_t compact_footprint(const m61_compact_header* h) {
+        return footprint_for(h->size, h->state == m61_compact_exclusive);
+    }
+    void compact_free(void* ptr, const char* file, int line);
+    void* compact_reallocate(void* ptr, size_t sz, const char* file, int line, bool exclusive);
+    int compact_walk(int (*callback)(const m61_block_info* block, void* ctx), void* ctx);
+};
+
+
+template <typename P>
+m61_heap<P>::m61_heap()
+    : buf(P::heap_size) {
+    alloc_stats.heap_min = (uintptr_t) buf.buffer;
+    alloc_stats.heap_max = (uintptr_t) buf.buffer + buf.size;
+    if constexpr (P::fit == m61_fit::buddy) {
+        static_assert(std::has_single_bit(P::heap_size), "buddy heaps must be a power of two");
+        // the whole heap starts as one free block of the largest order
+        free_insert(buf.buffer, buf.size);
+        buf.pos = buf.size;
+    }
+    if constexpr (P::compact_headers) {
+        static_assert(P::alignment == m61_slab::slot && P::fit != m61_fit::buddy,
+                      "compact headers need 16-byte alignment and first or best fit");
+        static_assert(P::heap_size <= UINT32_MAX, "compact header sizes are 32 bits");
+        // every block starts `header_size` bytes before an aligned payload
+        buf.pos = P::alignment - header_size;
+    }
+}
+
+// bytes a block of `sz` bytes reserves
+template <typename P>
+constexpr size_t m61_heap<P>::block_footprint(size_t sz) {
+    if constexpr (P::fit == m61_fit::buddy) {
+        return std::bit_ceil(classes::footprint(sz));
+    } else {
+        return classes::footprint(sz + header_size);
+    }
+}
+
+// bytes an exclusive block of `sz` bytes reserves. Buddy blocks are aligned
+// to their size, so a line-sized block is enough. A compact header sits in
+// the line below the payload, and the next block's header must not enter
+// the payload's last line
+template <typename P>
+constexpr size_t m61_heap<P>::exclusive_footprint(size_t sz) {
+    size_t lines = (sz + (sz == 0) + m61_cache_line - 1) & ~(m61_cache_line - 1);
+    if constexpr (P::fit == m61_fit::buddy) {
+        return std::max(block_footprint(sz), m61_cache_line);
+    } else {
+        return lines + 2 * header_size;
+    }
+}
+
+// true if this operation should be recorded in the histograms
+template <typename P>
+inline bool m61_heap<P>::sample_histogram() {
+    if constexpr (P::histogram_sampling <= 1) {
+        return P::histogram_sampling == 1;
+    } else {
+        return ++histogram_tick % P::histogram_sampling == 0;
+    }
+}
+
+template <typename P>
+void m61_heap<P>::free_insert(void* ptr, size_t sz) {
+    free_ptrs.insert({ptr, sz});
+    free_sizes.insert({sz, ptr});
+    free_list_size += sz;
+}
+
+template <typename P>
+void m61_heap<P>::free_erase(freemap_iter it) {
+    free_sizes.erase({it->second, it->first});
+    free_list_size -= it->second;
+    free_ptrs.erase(it);
+}
+
+// records a new live block at `ptr`; returns its payload
+template <typename P>
+void* m61_heap<P>::reserve(void* ptr, size_t sz, size_t footprint, const char* file, int line,
+                           bool exclusive) {
+    if constexpr (P::compact_headers) {
+        m61_compact_header* h = (m61_compact_header*) ptr;
+        h->size = sz;
+        h->state = exclusive ? m61_compact_exclusive : m61_compact_active;
+        h->site = site_id(file, line);
+        count_site(h->site, 1, sz);
+        ++nheadered;
+        ++alloc_epoch;
+        ptr = h + 1;
+        if constexpr (P::debug_checks) {
+            block b;
+            b.size = sz;
+            b.footprint = footprint;
+            b.birth = alloc_epoch;
+            if constexpr (P::site_tracking) {
+                b.site = h->site;
+            }
+            active_ptrs.insert({ptr, b});
+        }
+    } else {
+        block b;
+        b.size = sz;
+        b.footprint = footprint;
+        b.birth = alloc_epoch++;
+        if constexpr (P::site_tracking) {
+            b.site = site_id(file, line);
+            count_site(b.site, 1, sz);
+        } else {
+            (void) file, (void) line;
+        }
+        (void) exclusive;
+        active_ptrs.insert({ptr, b});
+    }
+    in_use += footprint;
+    if constexpr (P::statistics) {
+        alloc_stats.active_size += sz;
+        alloc_stats.padding_size += footprint - header_size - sz;
+        alloc_stats.nactive++;
+    }
+    return ptr;
+}
+
+// carves `footprint` bytes off the front of free block `it`, or, for an
+// exclusive block, off the first place that puts its payload on a line
+template <typename P>
+void* m61_heap<P>::take_free_block(freemap_iter it, size_t sz, size_t footprint,
+                                   const char* file, int line, bool exclusive) {
+    char* ptr = (char*) it->first;
+    size_t gap = exclusive ? line_gap(ptr) : 0;
+    size_t remaining = it->second - gap - footprint;
+    free_erase(it);
+    // split: the head and tail of the block stay free
+    if(gap != 0){
+        free_insert(ptr, gap);
+        ptr += gap;
+    }
+    if(remaining != 0){
+        free_insert(ptr + footprint, remaining);
+    }
+    return reserve(ptr, sz, footprint, file, line, exclusive);
+}
+
+// returns a free block of at least `footprint` bytes chosen by P::fit,
+// or free_ptrs.end()
+template <typename P>
+auto m61_heap<P>::fit_free_block(size_t footprint) -> freemap_iter {
+    if constexpr (P::fit == m61_fit::best) {
+        return best_fit(footprint);
+    } else {
+        fit_range& r = fit_ranges[m61_hist_bucket(footprint)];
+        if(P::adaptive_fit && r.best){
+            adapt_fit(r, 0);
+            return best_fit(footprint);
+        }
+        // scans free_ptr map and find an available buffer zone that's less than or equal to size
+        size_t steps = 0;
+        auto it = free_ptrs.begin();
+        while(it != free_ptrs.end() && footprint > it->second){
+            ++it;
+            ++steps;
+        }
+        if constexpr (P::statistics) {
+            alloc_stats.search_steps += steps;
+        }
+        if constexpr (P::adaptive_fit) {
+            adapt_fit(r, steps);
+        }
+        return it;
+    }
+}
+
+// the lowest free block that holds an exclusive block of `footprint` bytes
+// once its payload is moved up to a line boundary
+template <typename P>
+auto m61_heap<P>::fit_exclusive_block(size_t footprint) -> freemap_iter {
+    auto it = free_ptrs.begin();
+    while(it != free_ptrs.end() && line_gap((char*) it->first) + footprint > it->second){
+        ++it;
+    }
+    return it;
+}
+
+template <typename P>
+auto m61_heap<P>::best_fit(size_t footprint) -> freemap_iter {
+    auto sit = free_sizes.lower_bound({footprint, nullptr});
+    return sit == free_sizes.end() ? free_ptrs.end() : free_ptrs.find(sit->second);
+}
+
+// counts a free-list search of range `r` that took `steps` first-fit steps,
+// and at the end of a window decides the range's strategy for the next one
+template <typename P>
+void m61_heap<P>::adapt_fit(fit_range& r, size_t steps) {
+    r.steps += steps;
+    if(++r.allocs != fit_window){
+        return;
+    }
+    bool was_best = r.best;
+    if(r.best){
+        r.best = --r.hold != 0;
+    }
+    else if(r.steps > (unsigned long long) fit_long_search * fit_window){
+        // searches ran long (again, if this was a probe): back off longer
+        r.best = true;
+        r.hold = r.next_hold;
+        r.next_hold = std::min(r.next_hold * 2, fit_max_hold);
+    }
+    else{
+        r.next_hold = fit_min_hold;
+    }
+    if constexpr (P::statistics) {
+        alloc_stats.fit_switches += r.best != was_best;
+    }
+    r.allocs = 0;
+    r.steps = 0;
+}
+
+// helper function for allocate()
+// always checks diff(heap ceiling - buffer.current_pos) first to see if an allocation reside there first
+// otherwise, checks free regions of memory
+template <typename P>
+void* m61_heap<P>::m61_find_free_space(size_t sz, const char* file, int line, bool exclusive) {
+    if (sz > buf.size) {
+        return nullptr;
+    }
+    size_t footprint = footprint_for(sz, exclusive);
+    if constexpr (P::fit == m61_fit::buddy) {
+        return buddy_allocate(sz, footprint, file, line);
+    }
+    if constexpr (P::compact_headers) {
+        // tiny blocks go to slabs; with no slab to be had, they get a header
+        if(sz <= m61_slab::slot && !exclusive){
+            if(void* ptr = slab_allocate(sz, site_id(file, line))){
+                return ptr;
+            }
+        }
+    }
+
+    // try the buffer (i.e. check distance or space from current buffer.pos heap_max or ceiling)
+    size_t gap = exclusive ? line_gap(&buf.buffer[buf.pos]) : 0;
+    if (gap + footprint <= buf.size - buf.pos) {
+        // an exclusive block's alignment gap becomes a free block
+        if(gap != 0){
+            free_insert(&buf.buffer[buf.pos], gap);
+            buf.pos += gap;
+        }
+        void* ptr = &buf.buffer[buf.pos];
+        // the buffer is page-aligned and every footprint is a multiple of
+        // the alignment, so `pos` stays aligned
+        buf.pos += footprint;
+        high_water = std::max(high_water, buf.pos);
+        M61_PROBE2(arena_grow, ptr, buf.pos);
+        if constexpr (P::statistics) {
+            alloc_stats.nfrontier++;
+        }
+        return reserve(ptr, sz, footprint, file, line, exclusive);
+    }
+
+    // the free list as incremental coalescing has left it
+    auto it = exclusive ? fit_exclusive_block(footprint) : fit_free_block(footprint);
+    if(it != free_ptrs.end()){
+        if constexpr (P::statistics) {
+            alloc_stats.nfreelist++;
+        }
+        return take_free_block(it, sz, footprint, file, line, exclusive);
+    }
+
+    // about to fail: just-in-time coalescing of everything
+    consolidate_all_free_memory_regions(free_ptrs.begin());
+
+    if(retreat_frontier() && footprint <= buf.size - buf.pos){
+        return m61_find_free_space(sz, file, line, exclusive);
+    }
+
+    it = exclusive ? fit_exclusive_block(footprint) : fit_free_block(footprint);
+    if(it != free_ptrs.end()){
+        if constexpr (P::statistics) {
+            alloc_stats.nfreelist++;
+        }
+        return take_free_block(it, sz, footprint, file, line, exclusive);
+    }
+    return nullptr;
+}
+
+// a free block bordering the frontier merges into never-allocated memory.
+// Returns true if the frontier moved
+template <typename P>
+bool m61_heap<P>::retreat_frontier() {
+    if(!free_ptrs.empty()){
+        auto last = std::prev(free_ptrs.end());
+        if((char*) last->first + last->second == &buf.buffer[buf.pos]){
+            buf.pos -= last->second;
+            free_erase(last);
+            return true;
+        }
+    }
+    return false;
+}
+
+// runs the pressure callbacks, in registration order, until a `footprint`-byte
+// block fits under `limit`; with `limit == 0`, runs them all. Returns false
+// if no callback ran. Allocations made by the callbacks themselves skip them
+template <typename P>
+bool m61_heap<P>::relieve_pressure(size_t footprint, size_t limit) {
+    if(in_pressure || pressure_callbacks.empty()){
+        return false;
+    }
+    in_pressure = true;
+    // a copy: callbacks may remove themselves
+    auto callbacks = pressure_callbacks;
+    for(auto [callback, ctx] : callbacks){
+        if(limit != 0 && !over_limit(limit, footprint)){
+            break;
+        }
+        callback(limit != 0 ? in_use + footprint - limit : footprint, ctx);
+    }
+    in_pressure = false;
+    return true;
+}
+
+template <typename P>
+bool m61_heap<P>::remove_pressure_callback(m61_pressure_callback callback, void* ctx) {
+    for(auto it = pressure_callbacks.begin(); it != pressure_callbacks.end(); ++it){
+        if(it->first == callback && it->second == ctx){
+            pressure_callbacks.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+// BUDDY SYSTEM: free_sizes, ordered by (size, address), doubles as the
+// per-order free lists. A block of order k lives at an offset that is a
+// multiple of 2^k, so its buddy is at offset ^ 2^k.
+template <typename P>
+void* m61_heap<P>::buddy_allocate(size_t sz, size_t footprint, const char* file, int line) {
+    // smallest order that fits, lowest address within it
+    auto sit = free_sizes.lower_bound({footprint, nullptr});
+    if(sit == free_sizes.end()){
+        return nullptr;
+    }
+    char* ptr = (char*) sit->second;
+    size_t size = sit->first;
+    free_erase(free_ptrs.find(ptr));
+    // split, keeping the lower half, until the block is the right order
+    while(size != footprint){
+        size /= 2;
+        free_insert(ptr + size, size);
+    }
+    return reserve(ptr, sz, footprint, file, line);
+}
+
+template <typename P>
+void m61_heap<P>::buddy_release(void* ptr, size_t footprint) {
+    size_t off = (char*) ptr - buf.buffer;
+    size_t size = footprint;
+    // merge while the buddy is free and whole (not split into smaller blocks)
+    while(size != buf.size){
+        auto it = free_ptrs.find(buf.buffer + (off ^ size));
+        if(it == free_ptrs.end() || it->second != size){
+            break;
+        }
+        free_erase(it);
+        off &= ~size;
+        size *= 2;
+    }
+    free_insert(buf.buffer + off, size);
+}
+
+template <typename P>
+void* m61_heap<P>::allocate(size_t sz, const char* file, int line, bool exclusive) {
+    buf.claim();
+    drain_remote_frees();
+    if constexpr (P::coalesce_budget != 0) {
+        coalesce_step(P::coalesce_budget);
+    }
+    // requests larger than the heap can never succeed; don't ask for relief
+    size_t footprint = sz <= buf.size ? footprint_for(sz, exclusive) : 0;
+
+    // past the soft limit, ask callbacks to shed memory first
+    if(footprint != 0 && over_limit(soft_limit, footprint)){
+        relieve_pressure(footprint, soft_limit);
+    }
+    void* ptr = nullptr;
+    if(!over_limit(hard_limit, footprint)){
+        ptr = m61_find_free_space(sz, file, line, exclusive);
+    }
+    // about to fail: one more chance after every callback has run
+    if(!ptr && footprint != 0 && relieve_pressure(footprint, 0)
+       && !over_limit(hard_limit, footprint)){
+        ptr = m61_find_free_space(sz, file, line, exclusive);
+    }
+    if(sample_histogram()){
+        size_hist[m61_hist_bucket(sz)] += P::histogram_sampling;
+    }
+    if constexpr (P::statistics) {
+        if(ptr){
+            alloc_stats.ntotal++;
+            alloc_stats.total_size += sz;
+        }
+        else{
+            alloc_stats.nfail++;
+            alloc_stats.fail_size += sz;
+        }
+    }
+    return ptr;
+}
+
+template <typename P>
+void* m61_heap<P>::calloc(size_t count, size_t sz, const char* file, int line, bool exclusive) {
+    // checks if result (i.e. y = a*b) wrapped around
+    if(sz != 0 && count > SIZE_MAX / sz){
+        if constexpr (P::statistics) {
+            alloc_stats.nfail++;
+        }
+        return nullptr;
+    }
+    void* ptr = allocate(count * sz, file, line, exclusive);
+    if (ptr) {
+        m61_fill_zero(ptr, count * sz);
+    }
+    return ptr;
+}
+
+template <typename P>
+void* m61_heap<P>::reallocate(void* ptr, size_t sz, const char* file, int line, bool exclusive) {
+    if(ptr == nullptr){
+        return allocate(sz, file, line, exclusive);
+    }
+    if(sz == 0){
+        free(ptr, file, line);
+        return nullptr;
+    }
+    drain_remote_frees();
+    check_unowned(ptr, file, line);
+    if constexpr (P::compact_headers) {
+        return compact_reallocate(ptr, sz, file, line, exclusive);
+    }
+    auto it = active_ptrs.find(ptr);
+    if(it == active_ptrs.end()){
+        invalid_free(ptr, file, line);
+        return nullptr;
+    }
+
+    // same footprint: resize in place
+    block& b = it->second;
+    if(sz <= buf.size && footprint_for(sz, exclusive) == b.footprint
+       && (!exclusive || line_gap((char*) ptr) == 0)){
+        if constexpr (P::statistics) {
+            alloc_stats.active_size += sz - b.size;
+            alloc_stats.padding_size -= sz - b.size;
+        }
+        if constexpr (P::site_tracking) {
+            count_site(b.site, 0, (long long) sz - (long long) b.size);
+        }
+        b.size = sz;
+        return ptr;
+    }
+
+    size_t old_size = b.size;
+    void* newptr = allocate(sz, file, line, exclusive);
+    if(newptr){
+        m61_copy(newptr, ptr, std::min(old_size, sz));
+        free_local(ptr, file, line);
+    }
+    return newptr;
+}
+
+template <typename P>
+bool m61_heap<P>::can_coalesce_up(freemap_iter it) {
+    assert(it != free_ptrs.end());
+    auto nextBlock = std::next(it);
+    // cannot coalesce if there's no next entry in free_ptrs map!
+    if(nextBlock == free_ptrs.end()){
+        return false;
+    }
+    return ((uintptr_t) it->first) + it->second == (uintptr_t) nextBlock->first;
+}
+
+// absorbs the free block directly following `it`; requires can_coalesce_up(it)
+template <typename P>
+void m61_heap<P>::merge_next(freemap_iter it) {
+    auto next = std::next(it);
+    // consolidate free blocks by adding next value's memory allocation to current block
+    free_sizes.erase({it->second, it->first});
+    it->second += next->second;
+    free_sizes.insert({it->second, it->first});
+
+    M61_PROBE2(coalesce, it->first, it->second);
+
+    // erasing stale pointer (its bytes now belong to `it`)
+    free_list_size += next->second;
+    if(coalesce_cursor == next->first){
+        coalesce_cursor = it->first;
+    }
+    free_erase(next);
+}
+
+template <typename P>
+void m61_heap<P>::coalesce_up(freemap_iter it) {
+    // absorb every directly-following free block, not just the first
+    while(can_coalesce_up(it)){
+        merge_next(it);
+    }
+}
+
+// merges the block just freed at `ptr`: at once with its free neighbours if
+// the policy has no coalescing budget, otherwise by an incremental step
+template <typename P>
+void m61_heap<P>::coalesce_freed(void* ptr) {
+    if constexpr (P::coalesce_budget != 0) {
+        coalesce_step(P::coalesce_budget);
+    } else {
+        auto it = free_ptrs.find(ptr);
+        if(it != free_ptrs.begin() && can_coalesce_up(std::prev(it))){
+            --it;
+            merge_next(it);
+        }
+        if(can_coalesce_up(it)){
+            merge_next(it);
+        }
+    }
+}
+
+// INCREMENTAL COALESCING: examines at most `budget` free blocks, starting at
+// the cursor and wrapping around, so each call's cost is bounded. Returns
+// the number of merges. Stops early once every block has been examined.
+template <typename P>
+size_t m61_heap<P>::coalesce_step(size_t budget) {
+    if constexpr (P::fit == m61_fit::buddy) {
+        // buddies merge as soon as they are freed
+        return 0;
+    }
+    if(free_ptrs.empty()){
+        return 0;
+    }
+    uint64_t t0 = m61_prof_enabled() ? m61_cycles() : 0;
+    size_t merges = 0;
+    size_t examined = 0;
+    auto it = free_ptrs.lower_bound(coalesce_cursor);
+    while(budget != 0 && examined < free_ptrs.size()){
+        --budget;
+        if(it == free_ptrs.end()){
+            it = free_ptrs.begin();
+        }
+        if(can_coalesce_up(it)){
+            merge_next(it);
+            ++merges;
+            examined = 0;
+        }
+        else{
+            ++it;
+            ++examined;
+        }
+    }
+    coalesce_cursor = it == free_ptrs.end() ? nullptr : it->first;
+    if(t0){
+        m61_prof_record(M61_PROF_COALESCE, m61_cycles() - t0);
+    }
+    return merges;
+}
+
+// DEFERRED COALESCING TECHNIQUE
+template <typename P>
+void m61_heap<P>::consolidate_all_free_memory_regions(freemap_iter it) {
+    // Iterator goes through all of the free elements in the map and performs consolidation;
+    // if it cannot, it simply skips that over and goes to next ... it doesn't short circuit
+    // prematurely if an adjacent free block cannot coalesce!!
+    uint64_t t0 = m61_prof_enabled() ? m61_cycles() : 0;
+    for (; it != free_ptrs.end(); it++) {
+        coalesce_up(it);
+    }
+    if(t0){
+        m61_prof_record(M61_PROF_COALESCE, m61_cycles() - t0);
+    }
+}
+
+// MAINTENANCE: work a background thread can take off the allocating
+// thread, run while the caller holds the heap otherwise idle. Drains remote
+// frees, runs a coalescing step of `budget`, then checks out (removes from
+// the free list) up to `max` free blocks of at least `min_size` bytes that
+// have not been trimmed since they were freed, storing them in `out`.
+// The caller releases their pages without holding the heap, then hands
+// them back with return_trimmed(). Returns the number checked out.
+template <typename P>
+size_t m61_heap<P>::maintain(size_t budget, size_t min_size, trim_range* out, size_t max) {
+    drain_remote_frees();
+    coalesce_step(budget);
+
+    // forget blocks that have since been reused or merged
+    if(trimmed_ptrs.size() > free_ptrs.size() + 64){
+        for(auto it = trimmed_ptrs.begin(); it != trimmed_ptrs.end(); ){
+            auto fit = free_ptrs.find(it->first);
+            it = fit != free_ptrs.end() && fit->second == it->second
+                ? std::next(it) : trimmed_ptrs.erase(it);
+        }
+    }
+
+    // largest blocks first; look at a bounded number of them
+    size_t n = 0;
+    size_t looked = 0;
+    for(auto sit = free_sizes.rbegin();
+        sit != free_sizes.rend() && sit->first >= min_size && n != max && looked != 4 * max;
+        ++sit, ++looked){
+        auto tit = trimmed_ptrs.find(sit->second);
+        if(tit == trimmed_ptrs.end() || tit->second != sit->first){
+            out[n] = {sit->second, sit->first};
+            ++n;
+        }
+    }
+    for(size_t i = 0; i != n; ++i){
+        free_erase(free_ptrs.find(out[i].first));
+    }
+    checked_out.assign(out, out + n);
+    std::sort(checked_out.begin(), checked_out.end());
+    return n;
+}
+
+template <typename P>
+void m61_heap<P>::return_trimmed(const trim_range* blocks, size_t n) {
+    for(size_t i = 0; i != n; ++i){
+        free_insert(blocks[i].first, blocks[i].second);
+        trimmed_ptrs[blocks[i].first] = blocks[i].second;
+    }
+    checked_out.clear();
+}
+
+template <typename P>
+void m61_heap<P>::free(void* ptr, const char* file, int line) {
+    if(!free_remote(ptr, file, line)){
+        free_local(ptr, file, line);
+    }
+}
+
+template <typename P>
+bool m61_heap<P>::free_remote(void* ptr, const char* file, int line) {
+    if(ptr == nullptr || buf.owned()){
+        return false;
+    }
+    // remote free: never touch the owner's maps, just queue the block
+    if constexpr (P::debug_checks) {
+        if(!contains(ptr) || (uintptr_t) ptr % P::alignment != 0){
+            fprintf(stderr, "MEMORY BUG %s:%i: invalid free of pointer %p, not in heap\n", file, line, ptr);
+            abort();
+        }
+    } else {
+        (void) file, (void) line;
+    }
+    m61_remote_free* node = (m61_remote_free*) ptr;
+    node->next = buf.remote_frees.load(std::memory_order_relaxed);
+    while(!buf.remote_frees.compare_exchange_weak(node->next, node,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed)){
+    }
+    return true;
+}
+
+// drains the remote-free stack in one batch; only called on the owner thread.
+// `next` is read before each local free, so a block pushed twice (which
+// would link it into a cycle) is caught by the double free check
+template <typename P>
+void m61_heap<P>::drain_remote_frees() {
+    if(buf.remote_frees.load(std::memory_order_relaxed) == nullptr){
+        return;
+    }
+    m61_remote_free* node = buf.remote_frees.exchange(nullptr, std::memory_order_acquire);
+    while(node != nullptr){
+        m61_remote_free* next = node->next;
+        free_local(node, "?", 0);
+        node = next;
+    }
+}
+
+// frees `ptr` against the owner's bookkeeping
+template <typename P>
+void m61_heap<P>::free_local(void* ptr, const char* file, int line) {
+    if(ptr == nullptr){
+        return;
+    }
+    check_unowned(ptr, file, line);
+    if constexpr (P::compact_headers) {
+        compact_free(ptr, file, line);
+        return;
+    }
+    auto iter = active_ptrs.find(ptr);
+    // can only free from allocate() map
+    if(iter == active_ptrs.end()){
+        invalid_free(ptr, file, line);
+        return;
+    }
+
+    block b = iter->second;
+    active_ptrs.erase(iter);
+    in_use -= b.footprint;
+    if constexpr (P::site_tracking) {
+        count_site(b.site, -1, -(long long) b.size);
+    }
+    if constexpr (P::statistics) {
+        alloc_stats.nactive--;
+        alloc_stats.active_size -= b.size;
+        alloc_stats.padding_size -= b.footprint - b.size;
+    }
+    if(sample_histogram()){
+        lifetime_hist[m61_hist_bucket(alloc_epoch - b.birth)] += P::histogram_sampling;
+    }
+    if constexpr (P::fit == m61_fit::buddy) {
+        buddy_release(ptr, b.footprint);
+    } else {
+        free_insert(ptr, b.footprint);
+        coalesce_freed(ptr);
+    }
+}
+
+template <typename P>
+void m61_heap<P>::invalid_free(void* ptr, const char* file, int line) {
+    if constexpr (P::debug_checks) {
+        // a freed block may since have merged into the free block before it
+        auto it = free_ptrs.upper_bound(ptr);
+        if(in_slab(ptr) && m61_slab::of(ptr)->slot_index(ptr) != m61_slab::nslots){
+            fprintf(stderr, "MEMORY BUG %s:%i: invalid free of pointer %p, double free\n", file, line, ptr);
+        }
+        else if(it != free_ptrs.begin() && (char*) ptr < (char*) std::prev(it)->first + std::prev(it)->second){
+            fprintf(stderr, "MEMORY BUG %s:%i: invalid free of pointer %p, double free\n", file, line, ptr);
+        }
+        else{
+            fprintf(stderr, "MEMORY BUG %s:%i: invalid free of pointer %p, not in heap\n", file, line, ptr);
+        }
+    }
+    abort();
+}
+
+template <typename P>
+m61_statistics m61_heap<P>::statistics() {
+    if(buf.owned()){
+        drain_remote_frees();
+    }
+
+    // derive the free-space view: free list plus the unused frontier
+    m61_statistics stats = alloc_stats;
+    size_t frontier = buf.size - buf.pos;
+    stats.free_size = free_list_size + frontier;
+    stats.nfree = free_ptrs.size() + (frontier != 0);
+    stats.largest_free = free_sizes.empty() ? 0 : free_sizes.rbegin()->first;
+    if(frontier > stats.largest_free){
+        stats.largest_free = frontier;
+    }
+    for(const trim_range& r : checked_out){
+        stats.free_size += r.second;
+        ++stats.nfree;
+        stats.largest_free = std::max<unsigned long long>(stats.largest_free, r.second);
+    }
+    stats.fragmentation = stats.free_size ? 1.0 - (double) stats.largest_free / stats.free_size : 0.0;
+    stats.metadata_size = active_ptrs.size() * m61_node_size<std::pair<void* const, block>>
+        + free_ptrs.size() * (m61_node_size<std::pair<void* const, size_t>>
+                              + m61_node_size<std::pair<size_t, void*>>);
+    if constexpr (P::compact_headers) {
+        // headers, plus each slab's bytes not in slots
+        stats.metadata_size += nheadered * header_size
+            + nslabs * (m61_slab::footprint - m61_slab::nslots * m61_slab::slot);
+    }
+    return stats;
+}
+
+template <typename P>
+int m61_heap<P>::walk(int (*callback)(const m61_block_info* block, void* ctx), void* ctx,
+                      bool drain) {
+    if(drain && buf.owned()){
+        drain_remote_frees();
+    }
+    if constexpr (P::compact_headers) {
+        return compact_walk(callback, ctx);
+    } else {
+        // free blocks are in free_ptrs or checked out by maintain()
+        auto ait = active_ptrs.begin();
+        auto fit = free_ptrs.begin();
+        auto cit = checked_out.begin();
+        while(ait != active_ptrs.end() || fit != free_ptrs.end() || cit != checked_out.end()){
+            bool checked = cit != checked_out.end()
+                && (fit == free_ptrs.end() || cit->first < fit->first);
+            void* free_next = checked ? cit->first
+                : fit != free_ptrs.end() ? fit->first : nullptr;
+            m61_block_info info;
+            if(!free_next || (ait != active_ptrs.end() && ait->first < free_next)){
+                info = {ait->first, ait->second.size, ait->second.footprint, M61_BLOCK_ACTIVE, "?", 0, 0};
+                if constexpr (P::site_tracking) {
+                    info.site = ait->second.site;
+                    info.file = m61_site_file(info.site);
+                    info.line = m61_site_line(info.site);
+                }
+                ++ait;
+            }
+            else if(checked){
+                info = {cit->first, cit->second, cit->second, M61_BLOCK_FREE, nullptr, 0, 0};
+                ++cit;
+            }
+            else{
+                info = {fit->first, fit->second, fit->second, M61_BLOCK_FREE, nullptr, 0, 0};
+                ++fit;
+            }
+            if(int r = callback(&info, ctx)){
+                return r;
+            }
+        }
+    }
+
+    if(buf.pos != buf.size){
+        size_t unused = buf.size - buf.pos;
+        m61_block_info info = {&buf.buffer[buf.pos], unused, unused,
+                               M61_BLOCK_UNUSED, nullptr, 0, 0};
+        return callback(&info, ctx);
+    }
+    return 0;
+}
+
+// COMPACT HEADERS
+
+// the site ID blocks store for (file, line); 0 without site tracking
+template <typename P>
+inline uint32_t m61_heap<P>::site_id(const char* file, int line) {
+    if constexpr (P::site_tracking) {
+        return m61_site_intern(file, line);
+    } else {
+        (void) file, (void) line;
+        return 0;
+    }
+}
+
+// adds `n` blocks and `bytes` bytes to the active totals of `site`
+template <typename P>
+inline void m61_heap<P>::count_site(uint32_t site, long long n, long long bytes) {
+    if constexpr (P::site_tracking && P::statistics) {
+        if(site >= site_counts.size()){
+            site_counts.resize(std::max<size_t>(site + 1, 2 * site_counts.size()));
+        }
+        site_counts[site].nactive += n;
+        site_counts[site].bytes += bytes;
+    } else {
+        (void) site, (void) n, (void) bytes;
+    }
+}
+
+// carves a slab block, whose payload starts on a page boundary, from the
+// frontier or else from the first free block that holds one. Bytes skipped
+// to reach the boundary stay free. Returns nullptr if there is no room
+template <typename P>
+char* m61_heap<P>::slab_block() {
+    constexpr size_t page = m61_slab::page;
+    // offset of the first slab block at or after offset `off`
+    auto slab_at = [] (size_t off) {
+        return ((off + header_size + page - 1) & ~(page - 1)) - header_size;
+    };
+
+    size_t b = slab_at(buf.pos);
+    if(b + m61_slab::footprint <= buf.size){
+        if(b != buf.pos){
+            free_insert(&buf.buffer[buf.pos], b - buf.pos);
+        }
+        buf.pos = b + m61_slab::footprint;
+        high_water = std::max(high_water, buf.pos);
+        M61_PROBE2(arena_grow, &buf.buffer[b], buf.pos);
+        return &buf.buffer[b];
+    }
+
+    for(auto it = free_ptrs.begin(); it != free_ptrs.end(); ++it){
+        size_t start = (char*) it->first - buf.buffer;
+        size_t end = start + it->second;
+        b = slab_at(start);
+        if(b + m61_slab::footprint <= end){
+            free_erase(it);
+            if(b != start){
+                free_insert(&buf.buffer[start], b - start);
+            }
+            if(b + m61_slab::footprint != end){
+                free_insert(&buf.buffer[b + m61_slab::footprint], end - b - m61_slab::footprint);
+            }
+            return &buf.buffer[b];
+        }
+    }
+    return nullptr;
+}
+
+// a slot for a block of `sz` <= 16 bytes from `site`, or nullptr if no
+// slab can be had
+template <typename P>
+void* m61_heap<P>::slab_allocate(size_t sz, uint32_t site) {
+    m61_slab* s = partial_slabs;
+    if(!s){
+        char* b = slab_block();
+        if(!b){
+            return nullptr;
+        }
+        // the slab is a block like any other, header included
+        m61_compact_header* h = (m61_compact_header*) b;
+        h->size = m61_slab::footprint - header_size;
+        h->state = m61_compact_active;
+        h->site = 0;
+        s = (m61_slab*) (h + 1);
+        s->prev = s->next = nullptr;
+        memset(s->used, 0, sizeof(s->used));
+        // bits past the last slot are never free
+        if(m61_slab::nslots % 64 != 0){
+            s->used[m61_slab::nslots / 64] = ~uint64_t(0) << (m61_slab::nslots % 64);
+        }
+        s->nfree = m61_slab::nslots;
+        partial_slabs = s;
+        slab_pages.set(((char*) s - buf.buffer) / m61_slab::page);
+        ++nslabs;
+        in_use += m61_slab::footprint;
+    }
+
+    size_t w = 0;
+    while(s->used[w] == ~uint64_t(0)){
+        ++w;
+    }
+    size_t i = w * 64 + std::countr_one(s->used[w]);
+    s->used[w] |= uint64_t(1) << (i % 64);
+    s->info[i].size = sz;
+    s->info[i].site = site;
+    count_site(site, 1, sz);
+    // full slabs leave the list; `s` is its head
+    if(--s->nfree == 0){
+        partial_slabs = s->next;
+        if(partial_slabs){
+            partial_slabs->prev = nullptr;
+        }
+    }
+    ++alloc_epoch;
+    if constexpr (P::statistics) {
+        alloc_stats.active_size += sz;
+        alloc_stats.padding_size += m61_slab::slot - sz;
+        alloc_stats.nactive++;
+    }
+    return s->slot_ptr(i);
+}
+
+// frees live slot `i` of slab `s`. An empty slab returns to the heap unless
+// it is the only one with free slots
+template <typename P>
+void m61_heap<P>::slab_release(m61_slab* s, size_t i) {
+    s->used[i / 64] &= ~(uint64_t(1) << (i % 64));
+    count_site(s->info[i].site, -1, -(long long) s->info[i].size);
+    if constexpr (P::statistics) {
+        alloc_stats.nactive--;
+        alloc_stats.active_size -= s->info[i].size;
+        alloc_stats.padding_size -= m61_slab::slot - s->info[i].size;
+    }
+    if(s->nfree++ == 0){
+        s->prev = nullptr;
+        s->next = partial_slabs;
+        if(partial_slabs){
+            partial_slabs->prev = s;
+        }
+        partial_slabs = s;
+    }
+    else if(s->nfree == m61_slab::nslots && (s->prev || s->next)){
+        if(s->prev){
+            s->prev->next = s->next;
+        }
+        else{
+            partial_slabs = s->next;
+        }
+        if(s->next){
+            s->next->prev = s->prev;
+        }
+        slab_pages.reset(((char*) s - buf.buffer) / m61_slab::page);
+        // a stale pointer to the slab must not find an active header
+        ((m61_compact_header*) s - 1)->state = m61_compact_freed;
+        --nslabs;
+        in_use -= m61_slab::footprint;
+        free_insert((char*) s - header_size, m61_slab::footprint);
+        coalesce_freed((char*) s - header_size);
+    }
+}
+
+// the header of active block `ptr` (not a slab slot), or nullptr if `ptr`
+// is not one
+template <typename P>
+m61_compact_header* m61_heap<P>::compact_header(void* ptr) {
+    if(!contains(ptr) || (char*) ptr == buf.buffer || (uintptr_t) ptr % P::alignment != 0
+       || (char*) ptr >= &buf.buffer[buf.pos]){
+        return nullptr;
+    }
+    m61_compact_header* h = (m61_compact_header*) ptr - 1;
+    if(h->state != m61_compact_active && h->state != m61_compact_exclusive){
+        return nullptr;
+    }
+    // a header copied into a block's payload looks as good as a real one
+    if constexpr (P::debug_checks) {
+        if(active_ptrs.find(ptr) == active_ptrs.end()){
+            return nullptr;
+        }
+    }
+    return h;
+}
+
+template <typename P>
+void m61_heap<P>::compact_free(void* ptr, const char* file, int line) {
+    if(in_slab(ptr)){
+        m61_slab* s = m61_slab::of(ptr);
+        size_t i = s->slot_index(ptr);
+        if(i == m61_slab::nslots || !s->live(i)){
+            invalid_free(ptr, file, line);
+            return;
+        }
+        slab_release(s, i);
+        return;
+    }
+
+    m61_compact_header* h = compact_header(ptr);
+    if(!h){
+        invalid_free(ptr, file, line);
+        return;
+    }
+    size_t footprint = compact_footprint(h);
+    h->state = m61_compact_freed;
+    if constexpr (P::debug_checks) {
+        active_ptrs.erase(ptr);
+    }
+    count_site(h->site, -1, -(long long) h->size);
+    --nheadered;
+    in_use -= footprint;
+    if constexpr (P::statistics) {
+        alloc_stats.nactive--;
+        alloc_stats.active_size -= h->size;
+        alloc_stats.padding_size -= footprint - header_size - h->size;
+    }
+    free_insert(h, footprint);
+    coalesce_freed(h);
+}
+
+template <typename P>
+void* m61_heap<P>::compact_reallocate(void* ptr, size_t sz, const char* file, int line,
+                                      bool exclusive) {
+    // resize in place when the block's slot or footprint still fits
+    size_t old_size;
+    bool fits;
+    if(in_slab(ptr)){
+        m61_slab* s = m61_slab::of(ptr);
+        size_t i = s->slot_index(ptr);
+        if(i == m61_slab::nslots || !s->live(i)){
+            invalid_free(ptr, file, line);
+            return nullptr;
+        }
+        old_size = s->info[i].size;
+        fits = sz <= m61_slab::slot && !exclusive;
+        if(fits){
+            count_site(s->info[i].site, 0, (long long) sz - (long long) old_size);
+            s->info[i].size = sz;
+        }
+    }
+    else{
+        m61_compact_header* h = compact_header(ptr);
+        if(!h){
+            invalid_free(ptr, file, line);
+            return nullptr;
+        }
+        old_size = h->size;
+        fits = sz <= buf.size && footprint_for(sz, exclusive) == compact_footprint(h)
+            && (!exclusive || line_gap((char*) h) == 0);
+        if(fits){
+            count_site(h->site, 0, (long long) sz - (long long) old_size);
+            if constexpr (P::debug_checks) {
+                active_ptrs.find(ptr)->second.size = sz;
+            }
+            h->size = sz;
+            h->state = exclusive ? m61_compact_exclusive : m61_compact_active;
+        }
+    }
+    if(fits){
+        if constexpr (P::statistics) {
+            alloc_stats.active_size += sz - old_size;
+            alloc_stats.padding_size -= sz - old_size;
+        }
+        return ptr;
+    }
+
+    void* newptr = allocate(sz, file, line, exclusive);
+    if(newptr){
+        m61_copy(newptr, ptr, std::min(old_size, sz));
+        free_local(ptr, file, line);
+    }
+    return newptr;
+}
+
+// visits blocks in address order by their headers. Free blocks are the
+// ones in free_ptrs or checked out by maintain(). Each region runs from a
+// block's payload to the next block's, headers between them included, so
+// the regions tile the heap. A slab reports its bookkeeping, each live slot,
+// each run of free slots, and its tail past the last slot
+template <typename P>
+int m61_heap<P>::compact_walk(int (*callback)(const m61_block_info* block, void* ctx), void* ctx) {
+    char* a = &buf.buffer[P::alignment - header_size];
+    char* end = &buf.buffer[buf.pos];
+    auto fit = free_ptrs.begin();
+    while(a < end){
+        char* p = a + header_size;
+        auto cit = std::find_if(checked_out.begin(), checked_out.end(),
+                                [a] (const trim_range& r) { return r.first == a; });
+        m61_block_info info;
+        size_t footprint;
+        if(fit != free_ptrs.end() && fit->first == a){
+            footprint = fit->second;
+            info = {p, footprint, footprint, M61_BLOCK_FREE, nullptr, 0, 0};
+            ++fit;
+        }
+        else if(cit != checked_out.end()){
+            footprint = cit->second;
+            info = {p, footprint, footprint, M61_BLOCK_FREE, nullptr, 0, 0};
+        }
+        else if(in_slab(p)){
+            m61_slab* s = (m61_slab*) p;
+            info = {s, 0, m61_slab_first_slot, M61_BLOCK_METADATA, nullptr, 0, 0};
+            if(int r = callback(&info, ctx)){
+                return r;
+            }
+            for(size_t i = 0; i != m61_slab::nslots; ){
+                size_t j = i + 1;
+                if(s->live(i)){
+                    uint32_t site = s->info[i].site;
+                    info = {s->slot_ptr(i), s->info[i].size, m61_slab::slot, M61_BLOCK_ACTIVE,
+                            m61_site_file(site), m61_site_line(site), site};
+                }
+                else{
+                    while(j != m61_slab::nslots && !s->live(j)){
+                        ++j;
+                    }
+                    size_t n = (j - i) * m61_slab::slot;
+                    info = {s->slot_ptr(i), n, n, M61_BLOCK_FREE, nullptr, 0, 0};
+                }
+                if(int r = callback(&info, ctx)){
+                    return r;
+                }
+                i = j;
+            }
+            char* tail = s->slot_ptr(m61_slab::nslots);
+            info = {tail, 0, size_t(p + m61_slab::footprint - tail), M61_BLOCK_METADATA,
+                    nullptr, 0, 0};
+            if(int r = callback(&info, ctx)){
+                return r;
+            }
+            a += m61_slab::footprint;
+            continue;
+        }
+        else{
+            m61_compact_header* h = (m61_compact_header*) a;
+            footprint = compact_footprint(h);
+            info = {p, h->size, footprint, M61_BLOCK_ACTIVE,
+                    m61_site_file(h->site), m61_site_line(h->site), h->site};
+        }
+        // the last block has no header after it
+        info.footprint = std::min(info.footprint, size_t(&buf.buffer[buf.size] - p));
+        if(int r = callback(&info, ctx)){
+            return r;
+        }
+        a += footprint;
+    }
+
+    // the unused frontier's payload would start after a header
+    if(buf.pos + header_size < buf.size){
+        size_t unused = buf.size - buf.pos;
+        m61_block_info info = {&buf.buffer[buf.pos + header_size], unused,
+                               unused - header_size, M61_BLOCK_UNUSED, nullptr, 0, 0};
+        return callback(&info, ctx);
+    }
+    return 0;
+}
+
+// HANDLES AND COMPACTION: a handle-owned block is an ordinary active block
+// that compact() may move while it is not pinned. Handles are indexes into
+// `handles`, so moving a block updates one entry.
+
+template <typename P>
+uint64_t m61_heap<P>::handle_allocate(size_t sz, const char* file, int line) {
+    void* ptr = allocate(sz, file, line);
+    if(!ptr){
+        return 0;
+    }
+    size_t i;
+    if(!free_handles.empty()){
+        i = free_handles.back();
+        free_handles.pop_back();
+    }
+    else{
+        i = handles.size();
+        handles.push_back({nullptr, 0});
+    }
+    handles[i] = {ptr, 0};
+    handle_blocks.insert({ptr, i});
+    return i + 1;
+}
+
+template <typename P>
+void m61_heap<P>::handle_free(uint64_t h, const char* file, int line) {
+    if(h == 0){
+        return;
+    }
+    handle_entry* e = find_handle(h, file, line);
+    void* ptr = e->ptr;
+    handle_blocks.erase(ptr);
+    *e = {nullptr, 0};
+    free_handles.push_back(h - 1);
+    free_local(ptr, file, line);
+}
+
+template <typename P>
+void* m61_heap<P>::pin(uint64_t h) {
+    handle_entry* e = find_handle(h, "?", 0);
+    ++e->pins;
+    return e->ptr;
+}
+
+template <typename P>
+void m61_heap<P>::unpin(uint64_t h) {
+    handle_entry* e = find_handle(h, "?", 0);
+    if(e->pins == 0){
+        if constexpr (P::debug_checks) {
+            fprintf(stderr, "MEMORY BUG: unpin of handle %" PRIu64 ", not pinned\n", h);
+        }
+        abort();
+    }
+    --e->pins;
+}
+
+template <typename P>
+auto m61_heap<P>::find_handle(uint64_t h, const char* file, int line) -> handle_entry* {
+    if(h == 0 || h > handles.size() || handles[h - 1].ptr == nullptr){
+        if constexpr (P::debug_checks) {
+            fprintf(stderr, "MEMORY BUG %s:%i: invalid handle %" PRIu64 "\n", file, line, h);
+        }
+        abort();
+    }
+    return &handles[h - 1];
+}
+
+// handle-owned blocks must be freed and resized through their handles
+template <typename P>
+inline void m61_heap<P>::check_unowned(void* ptr, const char* file, int line) {
+    if(!handle_blocks.empty() && handle_blocks.count(ptr)){
+        if constexpr (P::debug_checks) {
+            fprintf(stderr, "MEMORY BUG %s:%i: invalid free of pointer %p, owned by a handle\n",
+                    file, line, ptr);
+        }
+        abort();
+    }
+}
+
+// moves active block `ptr` into the lowest free block below it that holds
+// it or borders it, sliding it down; returns its new address, or nullptr
+// if there is no such free block. Slab slots do not move
+template <typename P>
+void* m61_heap<P>::relocate(void* ptr) {
+    char* start;
+    size_t footprint;
+    if constexpr (P::compact_headers) {
+        if(in_slab(ptr)){
+            return nullptr;
+        }
+        m61_compact_header* h = (m61_compact_header*) ptr - 1;
+        start = (char*) h;
+        footprint = compact_footprint(h);
+    } else {
+        start = (char*) ptr;
+        footprint = active_ptrs.find(ptr)->second.footprint;
+    }
+
+    auto fit = free_ptrs.begin();
+    while(fit != free_ptrs.end() && (char*) fit->first < start
+          && fit->second < footprint && (char*) fit->first + fit->second != start){
+        ++fit;
+    }
+    if(fit == free_ptrs.end() || (char*) fit->first > start){
+        return nullptr;
+    }
+    char* dest = (char*) fit->first;
+    size_t gap = fit->second;
+    free_erase(fit);
+    memmove(dest, start, footprint);
+    if(dest + gap == start){
+        // the hole moves above the block
+        free_insert(dest + footprint, gap);
+    }
+    else{
+        if(gap != footprint){
+            free_insert(dest + footprint, gap - footprint);
+        }
+        if constexpr (P::compact_headers) {
+            ((m61_compact_header*) start)->state = m61_compact_freed;
+        }
+        free_insert(start, footprint);
+    }
+
+    if constexpr (P::compact_headers) {
+        if constexpr (P::debug_checks) {
+            auto node = active_ptrs.extract(ptr);
+            node.key() = dest + header_size;
+            active_ptrs.insert(std::move(node));
+        }
+        return dest + header_size;
+    } else {
+        auto it = active_ptrs.find(ptr);
+        block b = it->second;
+        active_ptrs.erase(it);
+        active_ptrs.insert({dest, b});
+        return dest;
+    }
+}
+
+// COMPACTION: slides every unpinned handle-owned block, lowest first, into
+// the lowest free space below it, then returns the pages above the new
+// frontier to the OS. Returns the number of bytes returned
+template <typename P>
+size_t m61_heap<P>::compact() {
+    drain_remote_frees();
+    if constexpr (P::fit == m61_fit::buddy) {
+        // buddy blocks cannot slide
+        return 0;
+    }
+    consolidate_all_free_memory_regions(free_ptrs.begin());
+    for(auto hit = handle_blocks.begin(); hit != handle_blocks.end(); ){
+        handle_entry& e = handles[hit->second];
+        void* newptr = e.pins == 0 ? relocate(hit->first) : nullptr;
+        if(!newptr){
+            ++hit;
+            continue;
+        }
+        // the new address is lower, so it is not visited again
+        size_t i = hit->second;
+        hit = handle_blocks.erase(hit);
+        handle_blocks.insert({newptr, i});
+        e.ptr = newptr;
+        coalesce_step(P::coalesce_budget);
+    }
+    consolidate_all_free_memory_regions(free_ptrs.begin());
+    retreat_frontier();
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t lo = (buf.pos + page - 1) & ~(page - 1);
+    size_t hi = (high_water + page - 1) & ~(page - 1);
+    high_water = buf.pos;
+    if(lo >= hi){
+        return 0;
+    }
+    madvise(&buf.buffer[lo], hi - lo, MADV_DONTNEED);
+    return hi - lo;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include "m61heapdump.hh"
+#include "m61site.hh"
+#include <algorithm>
+#include <bitset>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+// dump writer state, on the stack of the forked child; records are staged
+// in `buf` and written with write(2) whenever it fills up
+namespace {
+
+struct dump_writer {
+    int fd;
+    int flags;
+    bool ok = true;
+    char buf[16 << 10];
+    size_t len = 0;
+    // site ID => whether an M61_DUMP_SITE record has defined it
+    std::bitset<m61_site_capacity> sites_defined;
+
+    void append(const void* data, size_t sz);
+    void flush();
+};
+
+}
+
+void dump_writer::append(const void* data, size_t sz) {
+    const char* p = (const char*) data;
+    while (sz != 0) {
+        if (this->len == sizeof(this->buf)) {
+            this->flush();
+        }
+        size_t n = std::min(sz, sizeof(this->buf) - this->len);
+        memcpy(&this->buf[this->len], p, n);
+        this->len += n;
+        p += n;
+        sz -= n;
+    }
+}
+
+void dump_writer::flush() {
+    size_t off = 0;
+    while (off != this->len) {
+        ssize_t w = write(this->fd, &this->buf[off], this->len - off);
+        if (w <= 0) {
+            this->ok = false;
+            break;
+        }
+        off += w;
+    }
+    this->len = 0;
+}
+
+static int dump_block(const m61_block_info* b, void* arg) {
+    dump_writer* dw = (dump_writer*) arg;
+    uint8_t kind = b->state == M61_BLOCK_ACTIVE ? M61_DUMP_ACTIVE
+        : b->state == M61_BLOCK_FREE ? M61_DUMP_FREE
+        : b->state == M61_BLOCK_METADATA ? M61_DUMP_METADATA : M61_DUMP_UNUSED;
+    uint32_t site = kind == M61_DUMP_ACTIVE ? b->site : 0;
+
+    // define the site on its first use in the dump
+    if (site != 0 && site < m61_site_capacity && !dw->sites_defined[site]) {
+        dw->sites_defined[site] = true;
+        const char* file = m61_site_file(site);
+        size_t namelen = strlen(file);
+        m61_dump_record sr = {M61_DUMP_SITE, site, 0,
+                              (uint64_t) m61_site_line(site), namelen};
+        dw->append(&sr, sizeof(sr));
+        dw->append(file, namelen);
+    }
+
+    m61_dump_record r = {kind, site, (uintptr_t) b->ptr, b->size, b->footprint};
+    dw->append(&r, sizeof(r));
+    if (kind == M61_DUMP_ACTIVE && (dw->flags & M61_DUMP_CONTENTS)) {
+        dw->append(b->ptr, b->size);
+    }
+    return dw->ok ? 0 : -1;
+}
+
+bool m61_dump_write(int fd, int flags, m61_walk_function walk) {
+    dump_writer dw;
+    dw.fd = fd;
+    dw.flags = flags;
+
+    m61_dump_header h;
+    memcpy(h.magic, m61_dump_magic, sizeof(h.magic));
+    h.version = m61_dump_version;
+    h.record_size = sizeof(m61_dump_record);
+    h.flags = flags & M61_DUMP_CONTENTS;
+    h.pid = getppid();
+    h.time = time(nullptr);
+    dw.append(&h, sizeof(h));
+
+    walk(dump_block, &dw);
+    dw.flush();
+    return dw.ok;
+}
+
+
+bool m61_dump::load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        error = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+    data.clear();
+    char buf[BUFSIZ];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    if (data.size() < sizeof(header)
+        || (memcpy(&header, data.data(), sizeof(header)),
+            memcmp(header.magic, m61_dump_magic, sizeof(header.magic)) != 0)
+        || header.version != m61_dump_version
+        || header.record_size != sizeof(m61_dump_record)) {
+        error = std::string(path) + ": not an m61 heap dump";
+        return false;
+    }
+
+    blocks.clear();
+    sites.assign(1, {"?", 0});
+    size_t pos = sizeof(header);
+    while (pos + sizeof(m61_dump_record) <= data.size()) {
+        m61_dump_record r;
+        memcpy(&r, &data[pos], sizeof(r));
+        pos += sizeof(r);
+        bool has_contents = r.kind == M61_DUMP_ACTIVE && (header.flags & M61_DUMP_CONTENTS);
+        size_t extra = 0;
+        if (r.kind == M61_DUMP_SITE) {
+            extra = r.footprint;
+        } else if (has_contents) {
+            extra = r.size;
+        }
+        if (extra > data.size() - pos) {
+            break;
+        }
+        if (r.kind == M61_DUMP_SITE) {
+            if (sites.size() <= r.site) {
+                sites.resize(r.site + 1, {"?", 0});
+            }
+            sites[r.site] = {std::string(&data[pos], extra), (int) r.size};
+        } else {
+            blocks.push_back({(m61_dump_kind) r.kind, r.site, r.addr, r.size,
+                              r.footprint, has_contents ? pos : SIZE_MAX});
+        }
+        pos += extra;
+    }
+    if (pos != data.size()) {
+        error = std::string(path) + ": truncated heap dump";
+        return false;
+    }
+    return true;
+}
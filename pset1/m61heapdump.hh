@@ -0,0 +1,91 @@
+#ifndef M61HEAPDUMP_HH
+#define M61HEAPDUMP_HH 1
+#include "m61.hh"
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// m61 heap dumps
+///    m61_heap_dump() writes a snapshot of the heap to a binary file that
+///    `m61dump` analyzes offline. A dump is an m61_dump_header followed by
+///    m61_dump_records, one per heap block in address order. With
+///    M61_DUMP_CONTENTS, each active block's record is followed by its
+///    `size` bytes of contents. Sites are defined as in traces: before the
+///    first block from a site, an M61_DUMP_SITE record defines it (`site`
+///    is the site ID, `size` the line, `footprint` the length of the file
+///    name, which follows the record). Site ID 0, never defined, is unknown.
+
+enum m61_dump_kind : uint8_t {
+    M61_DUMP_ACTIVE = 1,
+    M61_DUMP_FREE = 2,
+    M61_DUMP_UNUSED = 3,        // never-allocated tail of the heap
+    M61_DUMP_SITE = 4,
+    M61_DUMP_METADATA = 5       // allocator bookkeeping (COMPACT slabs)
+};
+
+struct m61_dump_header {
+    char magic[8];              // "m61hdump"
+    uint32_t version;
+    uint32_t record_size;       // sizeof(m61_dump_record)
+    uint32_t flags;             // M61_DUMP_CONTENTS if contents follow
+    uint32_t pid;               // process that was dumped
+    uint64_t time;              // seconds since the epoch
+};
+
+struct __attribute__((packed)) m61_dump_record {
+    uint8_t kind;               // m61_dump_kind
+    uint32_t site;              // site ID (active blocks and M61_DUMP_SITE)
+    uint64_t addr;              // first byte of the block
+    uint64_t size;              // bytes requested (active) or available
+    uint64_t footprint;         // bytes the block occupies
+};
+
+static constexpr char m61_dump_magic[8] = {'m', '6', '1', 'h', 'd', 'u', 'm', 'p'};
+static constexpr uint32_t m61_dump_version = 2;
+
+
+/// m61_dump_write(fd, flags, walk)
+///    Write a dump of the heap that `walk` walks to `fd`. Runs in the
+///    child process m61_heap_dump() forks, so it allocates no memory and
+///    takes no locks. Returns true if every write succeeded.
+using m61_walk_function = int (*)(int (*callback)(const m61_block_info* block, void* ctx), void* ctx);
+bool m61_dump_write(int fd, int flags, m61_walk_function walk);
+
+
+/// m61_dump
+///    A heap dump loaded into memory.
+struct m61_dump {
+    struct block {
+        m61_dump_kind kind;
+        uint32_t site;
+        uint64_t addr;
+        uint64_t size;
+        uint64_t footprint;
+        size_t contents;        // offset of contents in `data`, or SIZE_MAX
+    };
+    struct site {
+        std::string file;
+        int line;
+    };
+
+    m61_dump_header header;
+    std::vector<block> blocks;
+    std::vector<site> sites;    // indexed by site ID; sites[0] is unknown
+    std::vector<char> data;     // the file
+
+    // load(path)
+    //    Read the dump at `path`. On failure, returns false and sets
+    //    `error` to a message.
+    bool load(const char* path);
+    std::string error;
+
+    const site& site_of(const block& b) const {
+        return sites[b.site < sites.size() ? b.site : 0];
+    }
+    const char* contents_of(const block& b) const {
+        return b.contents == SIZE_MAX ? nullptr : &data[b.contents];
+    }
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "m61leak.hh"
+#include <algorithm>
+#include <atomic>
+#include <csetjmp>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <link.h>
+#include <pthread.h>
+
+// Conservative reachability scan: every aligned pointer-sized word in the
+// roots (the calling thread's stack and registers, the writable segments of
+// every loaded object, and a range the caller names) or in a reachable block that points into
+// an active block makes that block reachable. Marking proceeds in rounds;
+// each round's newly marked blocks are split among worker threads.
+
+namespace {
+
+struct leak_scan {
+    const m61_block_info* blocks;           // active blocks, address order
+    size_t nblocks;
+    std::unique_ptr<std::atomic<bool>[]> marked;
+    uintptr_t lo = 0;                       // [lo, hi) spans every block
+    uintptr_t hi = 0;
+    const char* skip_first;                 // not a root
+    const char* skip_last;
+    const char* root_first;                 // a root outside the segments
+    const char* root_last;
+
+    // index of the block containing address `a`, or -1
+    ptrdiff_t find(uintptr_t a) const;
+    // mark blocks referenced from [first, last), appending newly marked
+    // ones to `found`
+    void scan(const char* first, const char* last, std::vector<size_t>& found);
+};
+
+}
+
+ptrdiff_t leak_scan::find(uintptr_t a) const {
+    if (a < lo || a >= hi) {
+        return -1;
+    }
+    auto it = std::upper_bound(blocks, blocks + nblocks, a,
+        [] (uintptr_t x, const m61_block_info& b) {
+            return x < (uintptr_t) b.ptr;
+        });
+    if (it == blocks) {
+        return -1;
+    }
+    --it;
+    // interior pointers count; the footprint covers padding
+    return a < (uintptr_t) it->ptr + std::max(it->footprint, size_t(1))
+        ? it - blocks : -1;
+}
+
+void leak_scan::scan(const char* first, const char* last, std::vector<size_t>& found) {
+    uintptr_t a = ((uintptr_t) first + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    for (; a + sizeof(void*) <= (uintptr_t) last; a += sizeof(void*)) {
+        uintptr_t v;
+        memcpy(&v, (const void*) a, sizeof(v));
+        ptrdiff_t i = find(v);
+        if (i >= 0 && !marked[i].exchange(true, std::memory_order_relaxed)) {
+            found.push_back(i);
+        }
+    }
+}
+
+// overwrite the stack below the caller with zeros, so dead frames' stale
+// pointers do not keep blocks alive
+__attribute__((noinline)) static void scrub_stack() {
+    volatile char buf[4096];
+    for (size_t i = 0; i != sizeof(buf); ++i) {
+        buf[i] = 0;
+    }
+}
+
+__attribute__((noinline)) static void scan_roots(leak_scan& ls, std::vector<size_t>& found) {
+    // writable segments of the executable and shared libraries
+    auto segments = [] (dl_phdr_info* info, size_t, void* arg) {
+        auto& ls_found = *(std::pair<leak_scan*, std::vector<size_t>*>*) arg;
+        for (int i = 0; i != info->dlpi_phnum; ++i) {
+            const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+            if (ph.p_type == PT_LOAD && (ph.p_flags & PF_W)) {
+                leak_scan* s = ls_found.first;
+                const char* first = (const char*) (info->dlpi_addr + ph.p_vaddr);
+                const char* last = first + ph.p_memsz;
+                if (s->skip_first >= first && s->skip_last <= last) {
+                    s->scan(first, s->skip_first, *ls_found.second);
+                    s->scan(s->skip_last, last, *ls_found.second);
+                } else {
+                    s->scan(first, last, *ls_found.second);
+                }
+            }
+        }
+        return 0;
+    };
+    std::pair<leak_scan*, std::vector<size_t>*> arg{&ls, &found};
+    dl_iterate_phdr(segments, &arg);
+    ls.scan(ls.root_first, ls.root_last, found);
+
+    // the stack, from here to its base; setjmp spills callee-saved registers
+    jmp_buf regs;
+    setjmp(regs);
+    pthread_attr_t attr;
+    void* stack_addr;
+    size_t stack_size;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        if (pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0) {
+            const char* sp = (const char*) &regs;
+            ls.scan(sp, (const char*) stack_addr + stack_size, found);
+        }
+        pthread_attr_destroy(&attr);
+    }
+}
+
+
+void m61_leak_scan(const m61_block_info* blocks, size_t nblocks, bool* reachable,
+                   int nthreads, const void* skip_first, const void* skip_last,
+                   const void* root_first, const void* root_last) {
+    // off the stack: `lo` must not count as a root
+    std::unique_ptr<leak_scan> lsp(new leak_scan);
+    leak_scan& ls = *lsp;
+    ls.blocks = blocks;
+    ls.nblocks = nblocks;
+    ls.skip_first = (const char*) skip_first;
+    ls.skip_last = (const char*) skip_last;
+    ls.root_first = (const char*) root_first;
+    ls.root_last = (const char*) root_last;
+    if (nblocks != 0) {
+        ls.lo = (uintptr_t) blocks[0].ptr;
+        const m61_block_info& last = blocks[nblocks - 1];
+        ls.hi = (uintptr_t) last.ptr + std::max(last.footprint, size_t(1));
+    }
+    ls.marked.reset(new std::atomic<bool>[nblocks]());
+    if (nthreads <= 0) {
+        nthreads = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    std::vector<size_t> frontier;
+    scrub_stack();
+    scan_roots(ls, frontier);
+
+    // mark transitively; small rounds are not worth a thread
+    while (!frontier.empty()) {
+        size_t nt = std::min<size_t>(nthreads, (frontier.size() + 255) / 256);
+        std::vector<std::vector<size_t>> found(nt);
+        auto work = [&] (size_t t) {
+            for (size_t i = t; i < frontier.size(); i += nt) {
+                const m61_block_info& b = ls.blocks[frontier[i]];
+                ls.scan((const char*) b.ptr, (const char*) b.ptr + b.size, found[t]);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < nt; ++t) {
+            threads.emplace_back(work, t);
+        }
+        work(0);
+        for (auto& th : threads) {
+            th.join();
+        }
+        frontier.clear();
+        for (auto& f : found) {
+            frontier.insert(frontier.end(), f.begin(), f.end());
+        }
+    }
+
+    for (size_t i = 0; i != nblocks; ++i) {
+        reachable[i] = ls.marked[i].load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef M61LEAK_HH
+#define M61LEAK_HH 1
+#include "m61.hh"
+
+// m61_leak_scan(blocks, nblocks, reachable, nthreads, skip_first, skip_last,
+//               root_first, root_last)
+//    Conservatively find which of the active blocks `blocks[0..nblocks)`
+//    (in address order) are reachable from the calling thread's stack and
+//    registers, from global data, and from [root_first, root_last),
+//    setting `reachable[i]` accordingly. [skip_first, skip_last) is the
+//    allocator's own state, which is not a root. Reachable blocks are
+//    scanned on up to `nthreads` threads.
+void m61_leak_scan(const m61_block_info* blocks, size_t nblocks, bool* reachable,
+                   int nthreads, const void* skip_first, const void* skip_last,
+                   const void* root_first, const void* root_last);
+
+#endif
@@ -0,0 +1,118 @@
+#include "m61memops.hh"
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define M61_X86 1
+#endif
+
+#if M61_X86
+// Each kernel takes a `vec`-aligned destination and a length that is a
+// multiple of 4 vectors; m61_fill_zero and m61_copy peel the rest off with
+// memset/memcpy. Streaming stores are weakly ordered: sfence before
+// returning so the block is visible like ordinary stores.
+
+static void fill_sse2(char* p, size_t n) {
+    __m128i z = _mm_setzero_si128();
+    for (; n != 0; n -= 64, p += 64) {
+        _mm_stream_si128((__m128i*) p, z);
+        _mm_stream_si128((__m128i*) (p + 16), z);
+        _mm_stream_si128((__m128i*) (p + 32), z);
+        _mm_stream_si128((__m128i*) (p + 48), z);
+    }
+    _mm_sfence();
+}
+
+__attribute__((target("avx2")))
+static void fill_avx2(char* p, size_t n) {
+    __m256i z = _mm256_setzero_si256();
+    for (; n != 0; n -= 128, p += 128) {
+        _mm256_stream_si256((__m256i*) p, z);
+        _mm256_stream_si256((__m256i*) (p + 32), z);
+        _mm256_stream_si256((__m256i*) (p + 64), z);
+        _mm256_stream_si256((__m256i*) (p + 96), z);
+    }
+    _mm_sfence();
+}
+
+static void copy_sse2(char* d, const char* s, size_t n) {
+    for (; n != 0; n -= 64, d += 64, s += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*) s);
+        __m128i b = _mm_loadu_si128((const __m128i*) (s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*) (s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*) (s + 48));
+        _mm_stream_si128((__m128i*) d, a);
+        _mm_stream_si128((__m128i*) (d + 16), b);
+        _mm_stream_si128((__m128i*) (d + 32), c);
+        _mm_stream_si128((__m128i*) (d + 48), e);
+    }
+    _mm_sfence();
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2(char* d, const char* s, size_t n) {
+    for (; n != 0; n -= 128, d += 128, s += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) s);
+        __m256i b = _mm256_loadu_si256((const __m256i*) (s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*) (s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i*) (s + 96));
+        _mm256_stream_si256((__m256i*) d, a);
+        _mm256_stream_si256((__m256i*) (d + 32), b);
+        _mm256_stream_si256((__m256i*) (d + 64), c);
+        _mm256_stream_si256((__m256i*) (d + 96), e);
+    }
+    _mm_sfence();
+}
+
+// kernels for this CPU, chosen on first use
+struct m61_memops {
+    size_t vec;         // bytes per vector
+    void (*fill)(char*, size_t);
+    void (*copy)(char*, const char*, size_t);
+};
+
+static const m61_memops& memops() {
+    static const m61_memops ops = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return m61_memops{32, fill_avx2, copy_avx2};
+        }
+        return m61_memops{16, fill_sse2, copy_sse2};
+    }();
+    return ops;
+}
+#endif
+
+
+void m61_fill_zero(void* ptr, size_t sz) {
+#if M61_X86
+    if (sz >= m61_nontemporal_threshold) {
+        const m61_memops& ops = memops();
+        char* p = (char*) ptr;
+        size_t head = -(uintptr_t) p & (ops.vec - 1);
+        size_t body = (sz - head) & ~(4 * ops.vec - 1);
+        memset(p, 0, head);
+        ops.fill(p + head, body);
+        memset(p + head + body, 0, sz - head - body);
+        return;
+    }
+#endif
+    memset(ptr, 0, sz);
+}
+
+void m61_copy(void* dst, const void* src, size_t sz) {
+#if M61_X86
+    if (sz >= m61_nontemporal_threshold) {
+        const m61_memops& ops = memops();
+        char* d = (char*) dst;
+        const char* s = (const char*) src;
+        size_t head = -(uintptr_t) d & (ops.vec - 1);
+        size_t body = (sz - head) & ~(4 * ops.vec - 1);
+        memcpy(d, s, head);
+        ops.copy(d + head, s + head, body);
+        memcpy(d + head + body, s + head + body, sz - head - body);
+        return;
+    }
+#endif
+    memcpy(dst, src, sz);
+}
@@ -0,0 +1,20 @@
+#ifndef M61MEMOPS_HH
+#define M61MEMOPS_HH 1
+#include <cstddef>
+
+// Bulk fill and copy for the allocator's own use (calloc zeroing, realloc
+// copying). From `m61_nontemporal_threshold` bytes up they use non-temporal
+// stores, AVX2 or SSE2 as the CPU allows, so a large block does not evict
+// the caller's working set from cache. Smaller sizes use memset/memcpy.
+
+static constexpr size_t m61_nontemporal_threshold = 1 << 20;
+
+// m61_fill_zero(ptr, sz)
+//    Set `sz` bytes at `ptr` to zero.
+void m61_fill_zero(void* ptr, size_t sz);
+
+// m61_copy(dst, src, sz)
+//    Copy `sz` bytes from `src` to `dst`. The ranges must not overlap.
+void m61_copy(void* dst, const void* src, size_t sz);
+
+#endif
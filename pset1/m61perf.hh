@@ -0,0 +1,66 @@
+#ifndef M61PERF_HH
+#define M61PERF_HH 1
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+#include <sys/resource.h>
+
+// Timing helpers shared by the m61 performance tools.
+
+/// m61_now_ns()
+///    Return a monotonic timestamp in nanoseconds.
+inline uint64_t m61_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// m61_peak_rss_kb()
+///    Return this process's peak resident set size in kilobytes.
+inline size_t m61_peak_rss_kb() {
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+#if __APPLE__
+    // Mac OS X reports memory usage in *bytes*, not KB
+    return u.ru_maxrss / 1024;
+#else
+    return u.ru_maxrss;
+#endif
+}
+
+/// m61_latencies
+///    Collects per-operation latencies and reports percentiles.
+struct m61_latencies {
+    std::vector<uint64_t> ns;
+    bool sorted = true;
+
+    void add(uint64_t x) {
+        ns.push_back(x);
+        sorted = false;
+    }
+    size_t count() const {
+        return ns.size();
+    }
+    // Return the `p`th percentile (0 <= p <= 100), or 0 if empty.
+    uint64_t percentile(double p) {
+        if (ns.empty()) {
+            return 0;
+        }
+        if (!sorted) {
+            std::sort(ns.begin(), ns.end());
+            sorted = true;
+        }
+        size_t i = (size_t) (p / 100 * (ns.size() - 1) + 0.5);
+        return ns[std::min(i, ns.size() - 1)];
+    }
+    uint64_t total() const {
+        uint64_t t = 0;
+        for (auto x : ns) {
+            t += x;
+        }
+        return t;
+    }
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "m61prof.hh"
+#include <cstdlib>
+#include <cstring>
+
+std::atomic<bool> m61_prof_on = false;
+
+// one thread's histograms; written only by that thread, read by
+// m61_prof_totals. Never freed, so counts survive the thread
+struct m61_prof_thread {
+    std::atomic<unsigned long long> hist[M61_PROF_NOPS][m61_hist_buckets];
+    m61_prof_thread* next;
+};
+
+static std::atomic<m61_prof_thread*> prof_threads;
+static thread_local m61_prof_thread* prof_self;
+
+// turn profiling on at startup if M61_PROFILE is set and not "0"
+static bool prof_env_init = [] {
+    const char* s = getenv("M61_PROFILE");
+    if (s && *s && strcmp(s, "0") != 0) {
+        m61_prof_on = true;
+    }
+    return true;
+}();
+
+void m61_prof_record(m61_prof_op op, uint64_t cycles) {
+    m61_prof_thread* t = prof_self;
+    if (!t) {
+        t = prof_self = new m61_prof_thread{};
+        t->next = prof_threads.load(std::memory_order_relaxed);
+        while (!prof_threads.compare_exchange_weak(t->next, t,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed)) {
+        }
+    }
+    auto& count = t->hist[op][m61_hist_bucket(cycles)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void m61_prof_totals(unsigned long long (*hist)[m61_hist_buckets]) {
+    memset(hist, 0, sizeof(unsigned long long) * M61_PROF_NOPS * m61_hist_buckets);
+    for (m61_prof_thread* t = prof_threads.load(std::memory_order_acquire);
+         t; t = t->next) {
+        for (int op = 0; op != M61_PROF_NOPS; ++op) {
+            for (int b = 0; b != m61_hist_buckets; ++b) {
+                hist[op][b] += t->hist[op][b].load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef M61PROF_HH
+#define M61PROF_HH 1
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+// Opt-in allocator profiling. Per-operation durations, in cycles, go into
+// per-thread log2 histograms when m61_profile_enable() or the M61_PROFILE
+// environment variable turns profiling on; otherwise each operation pays
+// one relaxed load.
+//
+// M61_PROBEn(name, ...) marks a USDT (SystemTap/DTrace-style) probe point
+// `m61:name`, for perf and bpftrace to attach to at run time; a disabled
+// probe is a single nop. Without <sys/sdt.h> the probes compile away.
+
+#if __has_include(<sys/sdt.h>)
+# include <sys/sdt.h>
+# define M61_PROBE1(name, a) STAP_PROBE1(m61, name, a)
+# define M61_PROBE2(name, a, b) STAP_PROBE2(m61, name, a, b)
+#else
+# define M61_PROBE1(name, a) ((void) (a))
+# define M61_PROBE2(name, a, b) ((void) (a), (void) (b))
+#endif
+
+// log2-bucketed histograms: bucket `b` counts values in [2^(b-1), 2^b),
+// bucket 0 counts zeros. Lifetimes are measured in allocation epochs: the
+// number of successful allocations from a block's own up to its free.
+static constexpr int m61_hist_buckets = 65;
+
+inline int m61_hist_bucket(unsigned long long x) {
+    return x == 0 ? 0 : 64 - __builtin_clzll(x);
+}
+
+enum m61_prof_op {
+    M61_PROF_MALLOC,
+    M61_PROF_FREE,
+    M61_PROF_CALLOC,
+    M61_PROF_REALLOC,
+    M61_PROF_COALESCE,
+    M61_PROF_NOPS
+};
+
+extern std::atomic<bool> m61_prof_on;
+
+inline bool m61_prof_enabled() {
+    return m61_prof_on.load(std::memory_order_relaxed);
+}
+
+// a cycle counter: the TSC where there is one, else nanoseconds
+inline uint64_t m61_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// m61_prof_record(op, cycles)
+//    Count one `op` taking `cycles` in the calling thread's histogram.
+void m61_prof_record(m61_prof_op op, uint64_t cycles);
+
+// m61_prof_totals(hist)
+//    Sum every thread's histograms into `hist[op][bucket]`.
+void m61_prof_totals(unsigned long long (*hist)[m61_hist_buckets]);
+
+#endif
@@ -0,0 +1,353 @@
+#include "m61region.hh"
+#include "m61heap.hh"
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Region layout: an m61_region_header, then blocks. Each block starts with
+// an m61_region_block header. All links are byte offsets from the start of
+// the region; offset 0 (the region header) means "none". Nothing in a region
+// refers to process memory, so several processes may map the same region;
+// they serialize on the process-shared mutex in the header.
+
+static constexpr char m61_region_magic[8] = {'m', '6', '1', 'r', 'e', 'g', 'o', 'n'};
+static constexpr uint32_t m61_region_version = 3;
+// `next` field of an active block, ORed with the block's slack (payload
+// bytes beyond the requested size, always < 64); catches frees of non-blocks
+static constexpr uint64_t m61_region_active = 0x6d36316163746900ULL;
+static constexpr uint64_t m61_region_slack_mask = 0xFF;
+
+struct m61_region_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t size;              // bytes in the region
+    uint64_t pos;               // offset of the never-allocated frontier
+    uint64_t free_head;         // first free block, in address order
+    uint64_t root;              // root object (a block's payload)
+    pthread_mutex_t lock;       // process-shared and robust, see m61_region_guard
+    uint64_t nactive;
+    uint64_t active_size;
+    uint64_t ntotal;
+    uint64_t total_size;
+    uint64_t nfail;
+    uint64_t fail_size;
+    uint64_t free_size;         // bytes in free-list blocks
+    uint64_t nfree;             // blocks in the free list
+};
+
+struct m61_region_block {
+    uint64_t size;              // bytes, including this header
+    uint64_t next;              // free: next free block; active: m61_region_active | slack
+};
+
+static constexpr uint64_t m61_region_first_block =
+    (sizeof(m61_region_header) + 15) & ~uint64_t(15);
+static constexpr uint64_t m61_region_min_block = 2 * sizeof(m61_region_block);
+
+struct m61_region {
+    int fd;
+    char* base;                 // the shared file mapping
+    size_t size;
+    m61_region_header* h;       // == base
+
+    m61_region_block* block(uint64_t off) const {
+        return (m61_region_block*) (base + off);
+    }
+    uint64_t offset(const void* ptr) const {
+        return (const char*) ptr - base;
+    }
+};
+
+// holds the region lock for its lifetime. The mutex is robust: if a process
+// dies holding it, the next locker takes it over instead of waiting forever.
+// Regions keep no journal, so an operation the dead process left half done
+// stays half done.
+struct m61_region_guard {
+    pthread_mutex_t* lock;
+
+    explicit m61_region_guard(m61_region* r)
+        : lock(&r->h->lock) {
+        if (pthread_mutex_lock(lock) == EOWNERDEAD) {
+            pthread_mutex_consistent(lock);
+        }
+    }
+    ~m61_region_guard() {
+        pthread_mutex_unlock(lock);
+    }
+};
+
+static void m61_region_init_lock(m61_region_header* h) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&h->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+
+// size `fd` for a new region (`fresh`) or read an existing region's size,
+// then map and format or validate it. Takes ownership of `fd`. The magic is
+// written last, so a file without it was never completely formatted.
+static m61_region* m61_region_map(int fd, size_t size, bool fresh) {
+    struct stat st;
+    if (fresh) {
+        size = (size + 15) & ~size_t(15);
+        if (size < m61_region_first_block + m61_region_min_block
+            || ftruncate(fd, size) != 0) {
+            close(fd);
+            return nullptr;
+        }
+    } else if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(m61_region_header)) {
+        close(fd);
+        return nullptr;
+    } else {
+        size = st.st_size;
+    }
+
+    // MAP_SHARED writes through to the file, so the heap outlives the process
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    M61_PROBE2(arena_map, base, size);
+    m61_region* r = new m61_region{fd, (char*) base, size, (m61_region_header*) base};
+    if (fresh) {
+        memset(r->h, 0, sizeof(m61_region_header));
+        r->h->version = m61_region_version;
+        r->h->header_size = sizeof(m61_region_header);
+        r->h->size = size;
+        r->h->pos = m61_region_first_block;
+        m61_region_init_lock(r->h);
+        memcpy(r->h->magic, m61_region_magic, sizeof(r->h->magic));
+    } else if (memcmp(r->h->magic, m61_region_magic, sizeof(r->h->magic)) != 0
+               || r->h->version != m61_region_version
+               || r->h->header_size != sizeof(m61_region_header)
+               || r->h->size != size) {
+        // not a region (or from an incompatible m61): leave it alone
+        m61_region_close(r);
+        return nullptr;
+    }
+    return r;
+}
+
+// true if file `fd` holds no region yet: it is empty, or a crash
+// interrupted its formatting before the magic was written
+static bool m61_region_unformatted(int fd) {
+    char magic[sizeof(m61_region_magic)];
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    if (n == 0) {
+        return true;
+    }
+    static constexpr char zero[sizeof(m61_region_magic)] = {};
+    return n == (ssize_t) sizeof(magic) && memcmp(magic, zero, sizeof(magic)) == 0;
+}
+
+m61_region* m61_region_open(const char* path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // openers check and format the file one at a time, so two processes
+    // creating the same file cannot both format it. A formatted region's
+    // lock is never reinitialized: the robust mutex recovers from a holder
+    // that died (see m61_region_guard), and reinitializing it under a live
+    // holder would break mutual exclusion.
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    m61_region* r = m61_region_map(fd, size, m61_region_unformatted(fd));
+    if (r) {
+        flock(r->fd, LOCK_UN);
+    }
+    return r;
+}
+
+m61_region* m61_region_create_shared(size_t size) {
+    int fd = memfd_create("m61region", MFD_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return m61_region_map(fd, size, true);
+}
+
+m61_region* m61_region_open_fd(int fd) {
+    int dupfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dupfd < 0) {
+        return nullptr;
+    }
+    return m61_region_map(dupfd, 0, false);
+}
+
+int m61_region_fd(m61_region* r) {
+    return r->fd;
+}
+
+void m61_region_close(m61_region* r) {
+    if (r) {
+        m61_region_sync(r);
+        munmap(r->base, r->size);
+        close(r->fd);
+        delete r;
+    }
+}
+
+int m61_region_sync(m61_region* r) {
+    return msync(r->base, r->size, MS_SYNC);
+}
+
+void* m61_region_malloc(m61_region* r, size_t sz) {
+    m61_region_guard guard(r);
+    m61_region_header* h = r->h;
+    uint64_t need = sz > h->size ? h->size + 1
+        : std::max((sz + 15) & ~uint64_t(15), uint64_t(16)) + sizeof(m61_region_block);
+
+    // first fit through the address-ordered free list
+    uint64_t* link = &h->free_head;
+    while (*link != 0 && r->block(*link)->size < need) {
+        link = &r->block(*link)->next;
+    }
+
+    m61_region_block* b;
+    if (*link != 0) {
+        b = r->block(*link);
+        if (b->size - need >= m61_region_min_block) {
+            // split: the tail stays free, in the same list position
+            m61_region_block* rest = (m61_region_block*) ((char*) b + need);
+            rest->size = b->size - need;
+            rest->next = b->next;
+            *link = r->offset(rest);
+            b->size = need;
+        } else {
+            *link = b->next;
+            --h->nfree;
+        }
+        h->free_size -= b->size;
+    } else if (need <= h->size - h->pos) {
+        b = r->block(h->pos);
+        b->size = need;
+        h->pos += need;
+    } else {
+        ++h->nfail;
+        h->fail_size += sz;
+        return nullptr;
+    }
+
+    b->next = m61_region_active | (b->size - sizeof(m61_region_block) - sz);
+    ++h->nactive;
+    h->active_size += sz;
+    ++h->ntotal;
+    h->total_size += sz;
+    return b + 1;
+}
+
+void m61_region_free(m61_region* r, void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    m61_region_guard guard(r);
+    m61_region_header* h = r->h;
+    uint64_t off = r->offset(ptr) - sizeof(m61_region_block);
+    m61_region_block* b = r->block(off);
+    if (off < m61_region_first_block || off >= h->pos || off % 16 != 0
+        || (b->next & ~m61_region_slack_mask) != m61_region_active) {
+        fprintf(stderr, "MEMORY BUG: invalid free of pointer %p, not in region\n", ptr);
+        abort();
+    }
+    --h->nactive;
+    h->active_size -= b->size - sizeof(m61_region_block) - (b->next & m61_region_slack_mask);
+    if (h->root == r->offset(ptr)) {
+        h->root = 0;
+    }
+
+    // find the free neighbors on either side
+    uint64_t prev = 0;
+    uint64_t* link = &h->free_head;
+    while (*link != 0 && *link < off) {
+        prev = *link;
+        link = &r->block(*link)->next;
+    }
+    b->next = *link;
+    *link = off;
+    ++h->nfree;
+    h->free_size += b->size;
+
+    // coalesce with the following block, then with the preceding block
+    if (b->next != 0 && off + b->size == b->next) {
+        m61_region_block* next = r->block(b->next);
+        b->size += next->size;
+        b->next = next->next;
+        --h->nfree;
+    }
+    if (prev != 0 && prev + r->block(prev)->size == off) {
+        m61_region_block* p = r->block(prev);
+        p->size += b->size;
+        p->next = b->next;
+        --h->nfree;
+        b = p;
+        off = prev;
+    }
+
+    // a free block that ends at the frontier returns to it
+    if (off + b->size == h->pos) {
+        uint64_t* l = &h->free_head;
+        while (*l != off) {
+            l = &r->block(*l)->next;
+        }
+        *l = 0;
+        h->pos = off;
+        h->free_size -= b->size;
+        --h->nfree;
+    }
+}
+
+void* m61_region_root(m61_region* r) {
+    m61_region_guard guard(r);
+    return m61_region_at(r, r->h->root);
+}
+
+void m61_region_set_root(m61_region* r, void* ptr) {
+    m61_region_guard guard(r);
+    r->h->root = m61_region_offset(r, ptr);
+}
+
+uint64_t m61_region_offset(m61_region* r, const void* ptr) {
+    return ptr ? r->offset(ptr) : 0;
+}
+
+void* m61_region_at(m61_region* r, uint64_t off) {
+    return off ? r->base + off : nullptr;
+}
+
+m61_statistics m61_region_get_statistics(m61_region* r) {
+    m61_region_guard guard(r);
+    m61_region_header* h = r->h;
+    m61_statistics stats = {};
+    stats.nactive = h->nactive;
+    stats.active_size = h->active_size;
+    stats.ntotal = h->ntotal;
+    stats.total_size = h->total_size;
+    stats.nfail = h->nfail;
+    stats.fail_size = h->fail_size;
+    stats.heap_min = (uintptr_t) r->base;
+    stats.heap_max = (uintptr_t) r->base + h->size;
+
+    uint64_t frontier = h->size - h->pos;
+    stats.free_size = h->free_size + frontier;
+    stats.nfree = h->nfree + (frontier != 0);
+    stats.largest_free = frontier;
+    for (uint64_t off = h->free_head; off != 0; off = r->block(off)->next) {
+        stats.largest_free = std::max(stats.largest_free, (unsigned long long) r->block(off)->size);
+    }
+    stats.fragmentation = stats.free_size ? 1.0 - (double) stats.largest_free / stats.free_size : 0.0;
+    stats.metadata_size = m61_region_first_block + (h->nactive + h->nfree) * sizeof(m61_region_block);
+    return stats;
+}
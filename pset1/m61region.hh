@@ -0,0 +1,124 @@
+#ifndef M61REGION_HH
+#define M61REGION_HH 1
+#include "m61.hh"
+#include <cstddef>
+#include <cstdint>
+
+// m61 regions: heaps whose bookkeeping lives inside the heap memory itself,
+// linked by offsets rather than pointers. A region mapped from a file
+// survives the process: reopening the file brings back every block and the
+// root object, wherever the mapping lands. A shared region lives in
+// anonymous shared memory; every process that maps it (through fork() or
+// m61_region_open_fd()) can allocate from it and free into it. A process
+// that dies in the middle of a region call does not leave the region
+// locked, though the call's own update may be left unfinished.
+
+struct m61_region;
+
+/// m61_region_open(path, size)
+///    Open the persistent heap stored in file `path`, creating and
+///    formatting it with `size` bytes if it does not exist or is empty.
+///    An existing heap keeps its original size. Returns `nullptr` on error.
+m61_region* m61_region_open(const char* path, size_t size);
+
+/// m61_region_create_shared(size)
+///    Create a `size`-byte region in shared memory not backed by any file.
+///    Child processes inherit it across fork(); other processes can attach
+///    with m61_region_open_fd(m61_region_fd(r)) once they receive the file
+///    descriptor. Returns `nullptr` on error.
+m61_region* m61_region_create_shared(size_t size);
+
+/// m61_region_open_fd(fd)
+///    Map the existing region in file descriptor `fd`, which may be a
+///    shared region's descriptor or an open region file. `fd` is not
+///    consumed. Returns `nullptr` on error.
+m61_region* m61_region_open_fd(int fd);
+
+/// m61_region_fd(r)
+///    Return the file descriptor backing `r`. It stays owned by `r`.
+int m61_region_fd(m61_region* r);
+
+/// m61_region_close(r)
+///    Write the heap back to its file and unmap it. The region itself
+///    lives on while any other process has it mapped.
+void m61_region_close(m61_region* r);
+
+/// m61_region_sync(r)
+///    Flush the heap's contents to its file. Returns 0 on success.
+int m61_region_sync(m61_region* r);
+
+/// m61_region_malloc(r, sz)
+///    Return a pointer to `sz` bytes of uninitialized memory in `r`, or
+///    `nullptr` if `r` is full.
+void* m61_region_malloc(m61_region* r, size_t sz);
+
+/// m61_region_free(r, ptr)
+///    Free a block returned by m61_region_malloc(r, ...). Does nothing if
+///    `ptr == nullptr`.
+void m61_region_free(m61_region* r, void* ptr);
+
+/// m61_region_root(r), m61_region_set_root(r, ptr)
+///    Get or set the region's root object, the entry point to the data
+///    structures it holds. The root is `nullptr` in a new region.
+void* m61_region_root(m61_region* r);
+void m61_region_set_root(m61_region* r, void* ptr);
+
+/// m61_region_offset(r, ptr), m61_region_at(r, off)
+///    Convert between a pointer into `r` and its offset from the start of
+///    the region, which is the same in every process mapping `r`. Pass
+///    offsets to hand blocks to other processes. Null converts to 0.
+uint64_t m61_region_offset(m61_region* r, const void* ptr);
+void* m61_region_at(m61_region* r, uint64_t off);
+
+/// m61_region_get_statistics(r)
+///    Return the region's statistics. Only the active, total, fail, heap
+///    and free-space fields are maintained.
+m61_statistics m61_region_get_statistics(m61_region* r);
+
+
+/// m61_offset_ptr<T>
+///    A pointer stored as the distance from itself to its target, so it
+///    stays valid wherever its region is mapped. Use it for links between
+///    objects inside a region; it must not point outside its own region.
+template <typename T>
+class m61_offset_ptr {
+public:
+    m61_offset_ptr() noexcept = default;
+    m61_offset_ptr(T* ptr) noexcept {
+        set(ptr);
+    }
+    m61_offset_ptr(const m61_offset_ptr& x) noexcept {
+        set(x.get());
+    }
+    m61_offset_ptr& operator=(const m61_offset_ptr& x) noexcept {
+        set(x.get());
+        return *this;
+    }
+    m61_offset_ptr& operator=(T* ptr) noexcept {
+        set(ptr);
+        return *this;
+    }
+
+    T* get() const noexcept {
+        // offset 0 would be a self-pointer; it means null
+        return off_ ? reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(this) + off_) : nullptr;
+    }
+    T* operator->() const noexcept {
+        return get();
+    }
+    T& operator*() const noexcept {
+        return *get();
+    }
+    explicit operator bool() const noexcept {
+        return off_ != 0;
+    }
+
+private:
+    intptr_t off_ = 0;
+
+    void set(T* ptr) noexcept {
+        off_ = ptr ? reinterpret_cast<intptr_t>(ptr) - reinterpret_cast<intptr_t>(this) : 0;
+    }
+};
+
+#endif
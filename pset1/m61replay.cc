@@ -0,0 +1,158 @@
+#include "m61.hh"
+#include "m61trace.hh"
+#include "m61perf.hh"
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+// m61replay: replay an allocation trace recorded with `M61_TRACE=PATH`
+// against this m61 build and report throughput, latency, and footprint.
+
+static void usage() {
+    fprintf(stderr, "Usage: m61replay [-n REPEAT] TRACE\n");
+    exit(1);
+}
+
+struct replay_site {
+    std::string file;
+    int line;
+};
+
+int main(int argc, char* argv[]) {
+    int repeat = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            repeat = strtol(optarg, nullptr, 0);
+        } else {
+            usage();
+        }
+    }
+    if (optind + 1 != argc || repeat < 1) {
+        usage();
+    }
+
+    // load the trace
+    FILE* f = fopen(argv[optind], "rb");
+    if (!f) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    std::vector<char> data;
+    char buf[BUFSIZ];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    m61_trace_header h;
+    if (data.size() < sizeof(h)
+        || (memcpy(&h, data.data(), sizeof(h)),
+            memcmp(h.magic, m61_trace_magic, sizeof(h.magic)) != 0)
+        || h.version < 1 || h.version > m61_trace_version
+        || h.record_size != sizeof(m61_trace_record)) {
+        fprintf(stderr, "%s: not an m61 trace\n", argv[optind]);
+        exit(1);
+    }
+
+    // decode records; site definitions are resolved up front
+    std::vector<m61_trace_record> ops;
+    std::vector<replay_site> sites(1, {"?", 0});
+    size_t nsites = 0;
+    uint32_t maxid = 0;
+    size_t pos = sizeof(h);
+    while (pos + sizeof(m61_trace_record) <= data.size()) {
+        m61_trace_record r;
+        memcpy(&r, &data[pos], sizeof(r));
+        pos += sizeof(r);
+        if (r.op == M61_TRACE_SITE) {
+            if (pos + r.time > data.size()) {
+                break;
+            }
+            if (sites.size() <= r.id) {
+                sites.resize(r.id + 1, {"?", 0});
+            }
+            sites[r.id] = {std::string(&data[pos], r.time), (int) r.size};
+            ++nsites;
+            pos += r.time;
+        } else {
+            ops.push_back(r);
+            maxid = std::max(maxid, r.id);
+        }
+    }
+    if (pos != data.size()) {
+        fprintf(stderr, "%s: warning: truncated trace\n", argv[optind]);
+    }
+
+    // replay
+    m61_latencies lat[4];
+    std::vector<void*> ptrs(maxid + 1, nullptr);
+    unsigned long long peak_active = 0, nfailed = 0;
+    uint64_t start = m61_now_ns();
+    for (int round = 0; round != repeat; ++round) {
+        for (auto& r : ops) {
+            const replay_site& s = sites[r.site < sites.size() ? r.site : 0];
+            int op = r.op & ~M61_TRACE_EXCLUSIVE;
+            bool exclusive = r.op & M61_TRACE_EXCLUSIVE;
+            uint64_t t0 = m61_now_ns();
+            void* ptr = nullptr;
+            if (op == M61_TRACE_MALLOC && exclusive) {
+                ptr = m61_malloc_exclusive(r.size, s.file.c_str(), s.line);
+            } else if (op == M61_TRACE_MALLOC) {
+                ptr = m61_malloc(r.size, s.file.c_str(), s.line);
+            } else if (op == M61_TRACE_CALLOC) {
+                bool was = m61_set_exclusive(exclusive);
+                if (r.size == UINT64_MAX) {
+                    ptr = m61_calloc(2, SIZE_MAX, s.file.c_str(), s.line);
+                } else {
+                    ptr = m61_calloc(1, r.size, s.file.c_str(), s.line);
+                }
+                m61_set_exclusive(was);
+            } else if (op == M61_TRACE_FREE) {
+                m61_free(ptrs[r.id], s.file.c_str(), s.line);
+                ptrs[r.id] = nullptr;
+            } else {
+                continue;
+            }
+            uint64_t t1 = m61_now_ns();
+            lat[op].add(t1 - t0);
+
+            if (op != M61_TRACE_FREE) {
+                if (r.id) {
+                    ptrs[r.id] = ptr;
+                }
+                if (!ptr && r.id) {
+                    ++nfailed;
+                }
+                peak_active = std::max(peak_active, m61_get_statistics().active_size);
+            }
+        }
+        // release anything the trace left live so rounds start equal
+        for (auto& p : ptrs) {
+            m61_free(p);
+            p = nullptr;
+        }
+    }
+    uint64_t elapsed = m61_now_ns() - start;
+
+    size_t nops = lat[M61_TRACE_MALLOC].count() + lat[M61_TRACE_CALLOC].count()
+        + lat[M61_TRACE_FREE].count();
+    uint64_t optime = lat[M61_TRACE_MALLOC].total() + lat[M61_TRACE_CALLOC].total()
+        + lat[M61_TRACE_FREE].total();
+    printf("trace:      %zu ops (%zu malloc, %zu calloc, %zu free), %zu sites, %d round(s)\n",
+           nops, lat[M61_TRACE_MALLOC].count(), lat[M61_TRACE_CALLOC].count(),
+           lat[M61_TRACE_FREE].count(), nsites, repeat);
+    printf("elapsed:    %.3f ms (%.3f ms in allocator)\n", elapsed / 1e6, optime / 1e6);
+    printf("throughput: %.0f ops/sec\n", optime ? nops / (optime / 1e9) : 0.0);
+    const char* names[4] = {nullptr, "malloc", "calloc", "free"};
+    for (int op = M61_TRACE_MALLOC; op <= M61_TRACE_FREE; ++op) {
+        if (lat[op].count()) {
+            printf("%-7s ns: p50 %6" PRIu64 "   p99 %6" PRIu64 "   p999 %6" PRIu64 "   max %8" PRIu64 "\n",
+                   names[op], lat[op].percentile(50), lat[op].percentile(99),
+                   lat[op].percentile(99.9), lat[op].percentile(100));
+        }
+    }
+    printf("peak active: %llu bytes   peak rss: %zukb   failed allocations: %llu\n",
+           peak_active, m61_peak_rss_kb(), nfailed);
+}
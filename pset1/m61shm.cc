@@ -0,0 +1,99 @@
+#include "m61shm.hh"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void m61_shm_name(int pid, char* buf, size_t sz) {
+    snprintf(buf, sz, "/m61stats.%d", pid);
+}
+
+m61_shm_stats* m61_shm_create(unsigned interval_ms) {
+    char name[64];
+    m61_shm_name(getpid(), name, sizeof(name));
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void* p = MAP_FAILED;
+    if (ftruncate(fd, sizeof(m61_shm_stats)) == 0) {
+        p = mmap(nullptr, sizeof(m61_shm_stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(name);
+        return nullptr;
+    }
+
+    // the new segment is zero-filled: no payload yet, `seq` even
+    m61_shm_stats* seg = (m61_shm_stats*) p;
+    memcpy(seg->magic, m61_shm_magic, sizeof(seg->magic));
+    seg->version = m61_shm_version;
+    seg->size = sizeof(m61_shm_stats);
+    seg->pid = getpid();
+    seg->interval_ms = interval_ms;
+    return seg;
+}
+
+void m61_shm_destroy(m61_shm_stats* seg) {
+    // a forked child inherits the mapping, but the segment is its parent's
+    bool owner = seg->pid == (uint32_t) getpid();
+    char name[64];
+    m61_shm_name(seg->pid, name, sizeof(name));
+    munmap(seg, sizeof(m61_shm_stats));
+    if (owner) {
+        shm_unlink(name);
+    }
+}
+
+void m61_shm_publish(m61_shm_stats* seg, const m61_shm_payload& data) {
+    uint64_t seq = seg->seq.load(std::memory_order_relaxed);
+    seg->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&seg->data, &data, sizeof(data));
+    seg->seq.store(seq + 2, std::memory_order_release);
+}
+
+const m61_shm_stats* m61_shm_attach(int pid) {
+    char name[64];
+    m61_shm_name(pid, name, sizeof(name));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void* p = mmap(nullptr, sizeof(m61_shm_stats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    // a segment from another m61 version must not be misread
+    const m61_shm_stats* seg = (const m61_shm_stats*) p;
+    if (memcmp(seg->magic, m61_shm_magic, sizeof(seg->magic)) != 0
+        || seg->version != m61_shm_version || seg->size != sizeof(m61_shm_stats)) {
+        munmap(p, sizeof(m61_shm_stats));
+        errno = EPROTO;
+        return nullptr;
+    }
+    return seg;
+}
+
+void m61_shm_detach(const m61_shm_stats* seg) {
+    munmap((void*) seg, sizeof(m61_shm_stats));
+}
+
+bool m61_shm_read(const m61_shm_stats* seg, m61_shm_payload* out) {
+    for (int tries = 0; tries != 1000; ++tries) {
+        uint64_t seq = seg->seq.load(std::memory_order_acquire);
+        if (seq % 2 == 0) {
+            memcpy(out, (const void*) &seg->data, sizeof(*out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seg->seq.load(std::memory_order_relaxed) == seq) {
+                return true;
+            }
+        }
+        sched_yield();
+    }
+    return false;
+}
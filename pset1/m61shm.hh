@@ -0,0 +1,78 @@
+#ifndef M61SHM_HH
+#define M61SHM_HH 1
+#include "m61.hh"
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+
+/// m61 statistics endpoint
+///    m61_stats_publish() makes the maintenance thread copy the heap's
+///    statistics, histograms and top allocation sites into the shared
+///    memory segment "/m61stats.PID" (see shm_open(3)) once per interval.
+///    `m61top PID` displays it. Readers map the segment read-only and copy
+///    it out with m61_shm_read(): `seq` is odd while an update is under
+///    way, so a copy is consistent if `seq` was even and unchanged across
+///    it.
+
+static constexpr size_t m61_shm_nsites = 16;
+static constexpr int m61_shm_hist_buckets = 65;
+
+struct m61_shm_site {
+    uint32_t site;              // site ID in the published process
+    int32_t line;
+    unsigned long long nactive; // active blocks from the site
+    unsigned long long bytes;   // bytes in them
+    char file[48];              // file name, truncated from the left
+};
+
+struct m61_shm_payload {
+    unsigned long long updates; // publications so far
+    uint64_t time_ns;           // CLOCK_REALTIME of this one
+    m61_statistics stats;
+    uint32_t histogram_sampling;
+    uint32_t nsites;            // entries in `sites`, largest first
+    unsigned long long size_hist[m61_shm_hist_buckets];
+    unsigned long long lifetime_hist[m61_shm_hist_buckets];
+    m61_shm_site sites[m61_shm_nsites];
+};
+
+struct m61_shm_stats {
+    char magic[8];              // "m61stats"
+    uint32_t version;
+    uint32_t size;              // sizeof(m61_shm_stats)
+    uint32_t pid;
+    uint32_t interval_ms;
+    std::atomic<uint64_t> seq;
+    m61_shm_payload data;
+};
+
+static constexpr char m61_shm_magic[8] = {'m', '6', '1', 's', 't', 'a', 't', 's'};
+static constexpr uint32_t m61_shm_version = 1;
+
+
+/// m61_shm_name(pid, buf, sz)
+///    Write the segment name of process `pid` into `buf`.
+void m61_shm_name(int pid, char* buf, size_t sz);
+
+/// m61_shm_create(interval_ms), m61_shm_destroy(seg)
+///    Create this process's segment, or unmap it and, if this process
+///    created it, remove it.
+m61_shm_stats* m61_shm_create(unsigned interval_ms);
+void m61_shm_destroy(m61_shm_stats* seg);
+
+/// m61_shm_publish(seg, data)
+///    Replace the segment's payload with `data`.
+void m61_shm_publish(m61_shm_stats* seg, const m61_shm_payload& data);
+
+/// m61_shm_attach(pid), m61_shm_detach(seg)
+///    Map process `pid`'s segment read-only, or unmap it. Returns nullptr,
+///    with `errno` set, if there is no valid segment.
+const m61_shm_stats* m61_shm_attach(int pid);
+void m61_shm_detach(const m61_shm_stats* seg);
+
+/// m61_shm_read(seg, out)
+///    Copy a consistent payload out of `seg`. Returns false if updates
+///    kept racing with the copy.
+bool m61_shm_read(const m61_shm_stats* seg, m61_shm_payload* out);
+
+#endif
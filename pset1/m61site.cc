@@ -0,0 +1,117 @@
+#include "m61site.hh"
+#include <atomic>
+#include <cstring>
+
+// The table: `site_entries[id]` holds site `id`, written once before the
+// ID is published, and `site_hash` is an open-addressed hash of IDs, each
+// slot claimed with one CAS. A thread that loses a race to intern the same
+// site adopts the winner's ID; the ID it reserved goes unused.
+
+namespace {
+
+struct site_entry {
+    const char* file;
+    int line;
+};
+
+struct site_cache_entry {
+    const char* file;
+    int line;
+    uint32_t id;
+};
+
+}
+
+static constexpr uint32_t site_hash_size = 2 * m61_site_capacity;
+static site_entry site_entries[m61_site_capacity];
+static std::atomic<uint32_t> site_hash[site_hash_size];
+static std::atomic<uint32_t> site_next = 1;
+
+// each thread remembers its recent sites by `file` pointer, so a call site
+// that allocates repeatedly neither hashes its file name nor touches the
+// shared table again
+static constexpr size_t site_cache_size = 64;
+static thread_local site_cache_entry site_cache[site_cache_size];
+
+static inline uint32_t site_cache_slot(const char* file, int line) {
+    uint64_t h = ((uintptr_t) file ^ ((uint64_t) line << 32 | (uint32_t) line))
+        * 0x9E3779B97F4A7C15ULL;
+    return (h >> 32) % site_cache_size;
+}
+
+// the shared table hashes file name contents (FNV-1a), as the same name
+// may reach m61 through different pointers
+static inline uint32_t site_hash_of(const char* file, int line) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const char* p = file; *p; ++p) {
+        h = (h ^ (unsigned char) *p) * 0x100000001B3ULL;
+    }
+    h = (h ^ (uint32_t) line) * 0x9E3779B97F4A7C15ULL;
+    return h >> 32;
+}
+
+static inline bool site_matches(const site_entry& e, const char* file, int line) {
+    return e.line == line && (e.file == file || strcmp(e.file, file) == 0);
+}
+
+static uint32_t site_intern_shared(const char* file, int line, uint32_t hash) {
+    uint32_t mine = 0;
+    for (uint32_t i = 0, slot = hash; i != site_hash_size; ++i, ++slot) {
+        std::atomic<uint32_t>& s = site_hash[slot % site_hash_size];
+        uint32_t id = s.load(std::memory_order_acquire);
+        if (id == 0) {
+            // reserve and fill in an entry, then try to publish it
+            if (mine == 0) {
+                mine = site_next.fetch_add(1, std::memory_order_relaxed);
+                if (mine >= m61_site_capacity) {
+                    site_next.store(m61_site_capacity, std::memory_order_relaxed);
+                    return 0;
+                }
+                site_entries[mine] = {file, line};
+            }
+            if (s.compare_exchange_strong(id, mine, std::memory_order_release,
+                                          std::memory_order_acquire)) {
+                return mine;
+            }
+            // lost the slot to `id`; it may be this very site
+        }
+        if (site_matches(site_entries[id], file, line)) {
+            return id;
+        }
+    }
+    return 0;
+}
+
+uint32_t m61_site_intern(const char* file, int line) {
+    if (!file) {
+        return 0;
+    }
+    site_cache_entry& c = site_cache[site_cache_slot(file, line)];
+    if (c.file != file || c.line != line) {
+        uint32_t id = site_intern_shared(file, line, site_hash_of(file, line));
+        if (id == 0) {
+            return 0;
+        }
+        c = {file, line, id};
+    }
+    return c.id;
+}
+
+const char* m61_site_file(uint32_t id) {
+    if (id == 0 || id > m61_site_count()) {
+        return "?";
+    }
+    return site_entries[id].file;
+}
+
+int m61_site_line(uint32_t id) {
+    if (id == 0 || id > m61_site_count()) {
+        return 0;
+    }
+    return site_entries[id].line;
+}
+
+uint32_t m61_site_count() {
+    uint32_t next = site_next.load(std::memory_order_relaxed);
+    return (next < m61_site_capacity ? next : m61_site_capacity) - 1;
+}
@@ -0,0 +1,36 @@
+#ifndef M61SITE_HH
+#define M61SITE_HH 1
+#include <cstddef>
+#include <cstdint>
+
+/// m61 allocation sites
+///    Every source location that allocates is interned once, on first use,
+///    in a global append-only table, and named thereafter by a 32-bit site
+///    ID. Blocks, traces and reports store the ID; the file name and line
+///    are looked up only when printed. Interning and lookup take no locks.
+///    Site ID 0 means "unknown".
+
+/// m61_site_capacity
+///    Sites the table can hold. Once it is full, new sites are unknown.
+static constexpr uint32_t m61_site_capacity = 1 << 14;
+
+/// m61_site_intern(file, line)
+///    Return the site ID of `file`:`line`, adding it to the table on first
+///    use. Sites are keyed by the file name's contents, so copies of one
+///    name share a site; each thread caches recent sites by `file` pointer.
+///    `file` must outlive the table. Returns 0 if `file` is null or the
+///    table is full.
+uint32_t m61_site_intern(const char* file, int line);
+
+/// m61_site_file(id), m61_site_line(id)
+///    Return the file name and line of site `id`; "?" and 0 if `id` is 0
+///    or not a site.
+const char* m61_site_file(uint32_t id);
+int m61_site_line(uint32_t id);
+
+/// m61_site_count()
+///    Return the number of site IDs handed out so far. Every site ID is at
+///    most this.
+uint32_t m61_site_count();
+
+#endif
@@ -0,0 +1,88 @@
+#include "m61stress.hh"
+#include <unistd.h>
+// m61stress: soak m61 with random allocation sequences checked against a
+// reference model. With -t, runs rounds of OPS operations, seed, seed+1, ...,
+// until SECONDS have passed; a failing round prints its seed for replay.
+
+static void usage() {
+    fprintf(stderr, "Usage: m61stress [-s SEED] [-n OPS] [-t SECONDS] [-l MAXLIVE]\n"
+                    "                 [-z MINSIZE:MAXSIZE] [-u] [-L LIFETIME]\n"
+                    "                 [-c CALLOC%%] [-r REALLOC%%] [-x EXCLUSIVE%%]\n"
+                    "                 [-p REPORT_EVERY]\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    m61_stress_config config;
+    double seconds = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:t:l:z:uL:c:r:x:p:")) != -1) {
+        switch (opt) {
+        case 's':
+            config.seed = strtoul(optarg, nullptr, 0);
+            break;
+        case 'n':
+            config.ops = strtoul(optarg, nullptr, 0);
+            break;
+        case 't':
+            seconds = strtod(optarg, nullptr);
+            break;
+        case 'l':
+            config.max_live = strtoul(optarg, nullptr, 0);
+            break;
+        case 'z':
+            if (sscanf(optarg, "%zu:%zu", &config.min_size, &config.max_size) != 2
+                || config.min_size == 0 || config.min_size > config.max_size) {
+                usage();
+            }
+            break;
+        case 'u':
+            config.log_sizes = false;
+            break;
+        case 'L':
+            config.mean_lifetime = strtod(optarg, nullptr);
+            break;
+        case 'c':
+            config.calloc_percent = strtoul(optarg, nullptr, 0);
+            break;
+        case 'r':
+            config.realloc_percent = strtoul(optarg, nullptr, 0);
+            break;
+        case 'x':
+            config.exclusive_percent = strtoul(optarg, nullptr, 0);
+            break;
+        case 'p':
+            config.report_every = strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc || config.max_live == 0 || config.mean_lifetime <= 0) {
+        usage();
+    }
+
+    uint64_t deadline = m61_now_ns() + (uint64_t) (seconds * 1e9);
+    m61_stress_result total;
+    size_t rounds = 0;
+    do {
+        m61_stress_result r = m61_stress(config).run();
+        total.nmalloc += r.nmalloc;
+        total.ncalloc += r.ncalloc;
+        total.nrealloc += r.nrealloc;
+        total.nfree += r.nfree;
+        total.nfail += r.nfail;
+        total.errors += r.errors;
+        total.peak_live_bytes = std::max(total.peak_live_bytes, r.peak_live_bytes);
+        total.elapsed += r.elapsed;
+        ++rounds;
+        ++config.seed;
+    } while (total.errors == 0 && m61_now_ns() < deadline);
+
+    printf("m61stress: %zu rounds, %zu ops (%zu malloc, %zu calloc, %zu realloc, %zu free), "
+           "%zu failed allocations, %.0f ops/sec, peak live %zu bytes, peak RSS %zu KiB, %zu errors\n",
+           rounds, total.ops(), total.nmalloc, total.ncalloc, total.nrealloc, total.nfree,
+           total.nfail, total.elapsed ? total.ops() / total.elapsed : 0.0,
+           total.peak_live_bytes, m61_peak_rss_kb(), total.errors);
+    return total.errors ? 1 : 0;
+}
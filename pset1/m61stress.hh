@@ -0,0 +1,309 @@
+#ifndef M61STRESS_HH
+#define M61STRESS_HH 1
+#include "m61.hh"
+#include "m61perf.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdarg>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <random>
+#include <tuple>
+#include <vector>
+
+// m61 stress engine: seedable random malloc/calloc/realloc/free sequences
+// checked against a reference model. Every block is filled with a pattern
+// derived from its ID, and the pattern is verified when the block is
+// reallocated or freed. New blocks must not overlap live ones, calloc
+// blocks must be zero, and m61_get_statistics() must agree with the model.
+// The same seed and configuration always produce the same sequence.
+
+/// m61_stress_config
+///    Parameters of one stress run.
+struct m61_stress_config {
+    unsigned long seed = 1;
+    size_t ops = 100000;            // operations to run
+    size_t max_live = 1000;         // live blocks at most
+    size_t min_size = 1;            // request sizes, inclusive
+    size_t max_size = 4096;
+    bool log_sizes = true;          // sizes log-uniform (else uniform)
+    double mean_lifetime = 200;     // mean block lifetime, in operations
+    unsigned calloc_percent = 10;   // of allocations
+    unsigned realloc_percent = 10;  // of deaths: realloc instead of free
+    unsigned exclusive_percent = 0; // of mallocs: m61_malloc_exclusive
+    size_t report_every = 0;        // ops between progress reports, 0 = none
+    FILE* report = stderr;          // where reports and errors go
+};
+
+/// m61_stress_result
+///    What a stress run did. `errors` counts failed checks; the run stops
+///    at the first one.
+struct m61_stress_result {
+    size_t nmalloc = 0;
+    size_t ncalloc = 0;
+    size_t nrealloc = 0;
+    size_t nfree = 0;
+    size_t nfail = 0;               // allocations that returned nullptr
+    size_t errors = 0;
+    size_t peak_live_bytes = 0;
+    double elapsed = 0;             // seconds
+
+    size_t ops() const {
+        return nmalloc + ncalloc + nrealloc + nfree;
+    }
+};
+
+
+class m61_stress {
+public:
+    explicit m61_stress(const m61_stress_config& config)
+        : config_(config), rng_(config.seed) {
+    }
+
+    m61_stress_result run();
+
+private:
+    struct live_block {
+        size_t size;
+        unsigned long id;
+    };
+    // (death time, block address, block ID), earliest first; an entry
+    // whose block has since been freed or moved is stale
+    using death = std::tuple<size_t, char*, unsigned long>;
+
+    m61_stress_config config_;
+    std::mt19937_64 rng_;
+    std::map<char*, live_block> live_;      // the reference model
+    std::priority_queue<death, std::vector<death>, std::greater<death>> deaths_;
+    size_t live_bytes_ = 0;
+    unsigned long next_id_ = 1;
+    size_t now_ = 0;                        // operation number
+    m61_statistics base_ = {};              // statistics before the run
+    m61_stress_result result_;
+
+    static unsigned char pattern(unsigned long id, size_t i) {
+        return (unsigned char) (id * 0x9E3779B1UL + i * 131 + (i >> 8));
+    }
+
+    bool stale(const death& d) const {
+        auto it = live_.find(std::get<1>(d));
+        return it == live_.end() || it->second.id != std::get<2>(d);
+    }
+    size_t random_size();
+    size_t random_lifetime();
+    __attribute__((format(printf, 2, 3))) bool error(const char* fmt, ...);
+    bool check_new(char* ptr, size_t sz, bool zeroed);
+    bool check_contents(char* ptr, const live_block& b, size_t n);
+    void fill(char* ptr, const live_block& b, size_t from);
+    bool allocate();
+    bool retire(char* ptr);
+    bool check_statistics();
+    void report(uint64_t t0);
+};
+
+
+inline size_t m61_stress::random_size() {
+    if (config_.log_sizes) {
+        double lo = std::log((double) config_.min_size);
+        double hi = std::log((double) config_.max_size + 1);
+        size_t sz = (size_t) std::exp(std::uniform_real_distribution<double>(lo, hi)(rng_));
+        return std::clamp(sz, config_.min_size, config_.max_size);
+    }
+    return uniform_int(config_.min_size, config_.max_size, rng_);
+}
+
+inline size_t m61_stress::random_lifetime() {
+    return 1 + (size_t) std::exponential_distribution<double>(1 / config_.mean_lifetime)(rng_);
+}
+
+inline bool m61_stress::error(const char* fmt, ...) {
+    fprintf(config_.report, "m61stress: seed %lu op %zu: ", config_.seed, now_);
+    va_list val;
+    va_start(val, fmt);
+    vfprintf(config_.report, fmt, val);
+    va_end(val);
+    fprintf(config_.report, "\n");
+    ++result_.errors;
+    return false;
+}
+
+// a new block must be aligned, disjoint from every live block, and zeroed
+// if it came from calloc
+inline bool m61_stress::check_new(char* ptr, size_t sz, bool zeroed) {
+    if ((uintptr_t) ptr % alignof(std::max_align_t) != 0) {
+        return error("block %p is misaligned", (void*) ptr);
+    }
+    auto next = live_.lower_bound(ptr);
+    if (next != live_.end() && next->first < ptr + std::max(sz, size_t(1))) {
+        return error("block %p overlaps live block %p", (void*) ptr, (void*) next->first);
+    }
+    if (next != live_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + std::max(prev->second.size, size_t(1)) > ptr) {
+            return error("block %p overlaps live block %p", (void*) ptr, (void*) prev->first);
+        }
+    }
+    for (size_t i = 0; zeroed && i != sz; ++i) {
+        if (ptr[i] != 0) {
+            return error("calloc block %p has nonzero byte at offset %zu", (void*) ptr, i);
+        }
+    }
+    return true;
+}
+
+inline bool m61_stress::check_contents(char* ptr, const live_block& b, size_t n) {
+    for (size_t i = 0; i != n; ++i) {
+        if ((unsigned char) ptr[i] != pattern(b.id, i)) {
+            return error("block %p corrupted at offset %zu", (void*) ptr, i);
+        }
+    }
+    return true;
+}
+
+inline void m61_stress::fill(char* ptr, const live_block& b, size_t from) {
+    for (size_t i = from; i < b.size; ++i) {
+        ptr[i] = pattern(b.id, i);
+    }
+}
+
+inline bool m61_stress::allocate() {
+    size_t sz = random_size();
+    bool zeroed = uniform_int(0U, 99U, rng_) < config_.calloc_percent;
+    char* ptr;
+    if (zeroed) {
+        ++result_.ncalloc;
+        ptr = (char*) m61_calloc(1, sz, "m61stress.hh", __LINE__);
+    } else if (config_.exclusive_percent
+               && uniform_int(0U, 99U, rng_) < config_.exclusive_percent) {
+        ++result_.nmalloc;
+        ptr = (char*) m61_malloc_exclusive(sz, "m61stress.hh", __LINE__);
+        // exclusive blocks start on a cache line
+        if (ptr && (uintptr_t) ptr % 64 != 0) {
+            return error("exclusive block %p is not line-aligned", (void*) ptr);
+        }
+    } else {
+        ++result_.nmalloc;
+        ptr = (char*) m61_malloc(sz, "m61stress.hh", __LINE__);
+    }
+    if (!ptr) {
+        ++result_.nfail;
+        return true;
+    }
+    if (!check_new(ptr, sz, zeroed)) {
+        return false;
+    }
+    live_block b = {sz, next_id_++};
+    fill(ptr, b, 0);
+    live_.insert({ptr, b});
+    live_bytes_ += sz;
+    result_.peak_live_bytes = std::max(result_.peak_live_bytes, live_bytes_);
+    deaths_.push({now_ + random_lifetime(), ptr, b.id});
+    return true;
+}
+
+// frees `ptr`, or reallocates it to a new size with a new lifetime
+inline bool m61_stress::retire(char* ptr) {
+    auto it = live_.find(ptr);
+    live_block b = it->second;
+    if (!check_contents(ptr, b, b.size)) {
+        return false;
+    }
+    live_.erase(it);
+    live_bytes_ -= b.size;
+
+    if (uniform_int(0U, 99U, rng_) < config_.realloc_percent) {
+        ++result_.nrealloc;
+        size_t sz = random_size();
+        char* nptr = (char*) m61_realloc(ptr, sz, "m61stress.hh", __LINE__);
+        if (!nptr) {
+            // the old block stays live
+            ++result_.nfail;
+            live_.insert({ptr, b});
+            live_bytes_ += b.size;
+            deaths_.push({now_ + random_lifetime(), ptr, b.id});
+            return true;
+        }
+        if (!check_new(nptr, sz, false)
+            || !check_contents(nptr, b, std::min(b.size, sz))) {
+            return false;
+        }
+        size_t old_size = b.size;
+        b.size = sz;
+        fill(nptr, b, old_size);
+        live_.insert({nptr, b});
+        live_bytes_ += sz;
+        result_.peak_live_bytes = std::max(result_.peak_live_bytes, live_bytes_);
+        deaths_.push({now_ + random_lifetime(), nptr, b.id});
+        return true;
+    }
+
+    ++result_.nfree;
+    m61_free(ptr, "m61stress.hh", __LINE__);
+    return true;
+}
+
+// the allocator's own accounting must match the model
+inline bool m61_stress::check_statistics() {
+    m61_statistics stat = m61_get_statistics();
+    if (stat.nactive != live_.size() + base_.nactive
+        || stat.active_size != live_bytes_ + base_.active_size) {
+        return error("statistics report %llu active blocks (%llu bytes), model has %zu (%zu bytes)",
+                     stat.nactive - base_.nactive, stat.active_size - base_.active_size,
+                     live_.size(), live_bytes_);
+    }
+    return true;
+}
+
+inline void m61_stress::report(uint64_t t0) {
+    double elapsed = (m61_now_ns() - t0) / 1e9;
+    m61_statistics stat = m61_get_statistics();
+    fprintf(config_.report,
+            "m61stress: %zu ops, %.0f ops/sec, %zu live blocks, %zu live bytes, "
+            "%llu free bytes, fragmentation %.3f, peak RSS %zu KiB\n",
+            now_ + 1, elapsed ? (now_ + 1) / elapsed : 0.0, live_.size(), live_bytes_,
+            stat.free_size, stat.fragmentation, m61_peak_rss_kb());
+}
+
+inline m61_stress_result m61_stress::run() {
+    uint64_t t0 = m61_now_ns();
+    base_ = m61_get_statistics();
+    bool ok = true;
+    for (now_ = 0; ok && now_ != config_.ops; ++now_) {
+        // a block due to die (or the oldest, if at the live limit) retires;
+        // otherwise allocate
+        while (!deaths_.empty() && stale(deaths_.top())) {
+            deaths_.pop();
+        }
+        if (!deaths_.empty()
+            && (std::get<0>(deaths_.top()) <= now_ || live_.size() >= config_.max_live)) {
+            char* ptr = std::get<1>(deaths_.top());
+            deaths_.pop();
+            ok = retire(ptr);
+        } else {
+            ok = allocate();
+        }
+        if (ok && (now_ & 1023) == 1023) {
+            ok = check_statistics();
+        }
+        if (config_.report_every && (now_ + 1) % config_.report_every == 0) {
+            report(t0);
+        }
+    }
+
+    // clean up: every surviving block is verified and freed
+    for (auto it = live_.begin(); ok && it != live_.end(); ++it) {
+        ok = check_contents(it->first, it->second, it->second.size);
+    }
+    for (auto& [ptr, b] : live_) {
+        m61_free(ptr, "m61stress.hh", __LINE__);
+    }
+    live_.clear();
+    live_bytes_ = 0;
+    deaths_ = {};
+    result_.elapsed = (m61_now_ns() - t0) / 1e9;
+    return result_;
+}
+
+#endif
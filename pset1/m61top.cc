@@ -0,0 +1,147 @@
+#include "m61shm.hh"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+// m61top: watch the statistics a running program publishes with
+// m61_stats_publish() (or M61_STATS=INTERVAL). Redraws the screen every
+// DELAY seconds; with -b, prints one report after another instead.
+
+static void usage() {
+    fprintf(stderr, "Usage: m61top [-n ITERATIONS] [-d SECONDS] [-b] PID\n");
+    exit(1);
+}
+
+static void print_histogram(const char* title, const unsigned long long* hist) {
+    unsigned long long maxcount = 0;
+    for (int b = 0; b != m61_shm_hist_buckets; ++b) {
+        maxcount = std::max(maxcount, hist[b]);
+    }
+    if (maxcount == 0) {
+        return;
+    }
+    printf("\n%s:\n", title);
+    for (int b = 0; b != m61_shm_hist_buckets; ++b) {
+        if (hist[b] != 0) {
+            unsigned long long lo = b ? 1ULL << (b - 1) : 0;
+            unsigned long long hi = b ? (b == 64 ? ~0ULL : (lo << 1) - 1) : 0;
+            int bar = (int) ((hist[b] * 40 + maxcount - 1) / maxcount);
+            printf("%10llu-%-10llu %10llu  %.*s\n", lo, hi, hist[b], bar,
+                   "########################################");
+        }
+    }
+}
+
+static void print_report(int pid, const m61_shm_payload& d, const m61_shm_payload* prev) {
+    const m61_statistics& s = d.stats;
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    double age = now.tv_sec + now.tv_nsec / 1e9 - d.time_ns / 1e9;
+    printf("m61top: pid %d, update %llu, %.1fs old\n", pid, d.updates, age);
+    if (d.updates == 0) {
+        printf("(nothing published yet)\n");
+        return;
+    }
+    printf("allocs:     active %12llu  total %14llu  fail %10llu\n",
+           s.nactive, s.ntotal, s.nfail);
+    printf("bytes:      active %12llu  total %14llu  fail %10llu\n",
+           s.active_size, s.total_size, s.fail_size);
+    printf("free:       %llu bytes in %llu blocks, largest %llu, fragmentation %.3f\n",
+           s.free_size, s.nfree, s.largest_free, s.fragmentation);
+    printf("overhead:   padding %llu bytes, metadata %llu bytes\n",
+           s.padding_size, s.metadata_size);
+    unsigned long long nplaced = s.nfrontier + s.nfreelist;
+    printf("placement:  frontier %llu, free list %llu, %.2f steps/alloc, %llu fit switches\n",
+           s.nfrontier, s.nfreelist,
+           nplaced ? (double) s.search_steps / nplaced : 0.0, s.fit_switches);
+    // between the two publications last read
+    if (prev && prev->updates != 0 && d.time_ns > prev->time_ns) {
+        double elapsed = (d.time_ns - prev->time_ns) / 1e9;
+        printf("rate:       %.0f allocs/s\n", (s.ntotal - prev->stats.ntotal) / elapsed);
+    }
+
+    char sampled[32] = "";
+    if (d.histogram_sampling > 1) {
+        snprintf(sampled, sizeof(sampled), " (1 in %u sampled)", d.histogram_sampling);
+    }
+    char title[64];
+    snprintf(title, sizeof(title), "request sizes%s", sampled);
+    print_histogram(title, d.size_hist);
+    snprintf(title, sizeof(title), "block lifetimes, in allocations%s", sampled);
+    print_histogram(title, d.lifetime_hist);
+
+    if (d.nsites != 0) {
+        printf("\ntop sites by active bytes:\n");
+        for (uint32_t i = 0; i != std::min(d.nsites, (uint32_t) m61_shm_nsites); ++i) {
+            const m61_shm_site& site = d.sites[i];
+            printf("%12llu bytes %8llu objects   %.*s:%d\n", site.bytes, site.nactive,
+                   (int) sizeof(site.file), site.file, site.line);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = -1;
+    double delay = 1;
+    bool batch = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:b")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtol(optarg, nullptr, 0);
+            break;
+        case 'd':
+            delay = strtod(optarg, nullptr);
+            break;
+        case 'b':
+            batch = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind + 1 != argc || delay <= 0) {
+        usage();
+    }
+    int pid = strtol(argv[optind], nullptr, 0);
+
+    const m61_shm_stats* seg = m61_shm_attach(pid);
+    if (!seg) {
+        fprintf(stderr, "m61top: pid %d: %s\n", pid, errno == ENOENT
+                ? "not publishing statistics (see m61_stats_publish)" : strerror(errno));
+        exit(1);
+    }
+
+    // `prev` is the publication read before the one shown, for the rate
+    m61_shm_payload cur, last, prev;
+    bool have_last = false, have_prev = false;
+    for (long n = 0; iterations < 0 || n != iterations; ++n) {
+        if (n != 0) {
+            usleep((useconds_t) (delay * 1e6));
+        }
+        // the segment outlives a program killed before exit
+        if (kill(pid, 0) != 0 && errno == ESRCH) {
+            fprintf(stderr, "m61top: pid %d has exited\n", pid);
+            break;
+        }
+        if (!m61_shm_read(seg, &cur)) {
+            continue;
+        }
+        if (have_last && cur.updates != last.updates) {
+            prev = last;
+            have_prev = true;
+        }
+        if (!batch) {
+            printf("\x1b[H\x1b[2J");
+        } else if (n != 0) {
+            printf("\n");
+        }
+        print_report(pid, cur, have_prev ? &prev : nullptr);
+        fflush(stdout);
+        last = cur;
+        have_last = true;
+    }
+    m61_shm_detach(seg);
+}
@@ -0,0 +1,139 @@
+#include "m61trace.hh"
+#include "m61.hh"
+#include "m61site.hh"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+// trace writer state; records are staged in `buf` and written with write(2)
+// whenever it fills up, on m61_trace_flush(), and at exit
+struct m61_trace_writer {
+    int fd = -1;
+    char buf[64 << 10];
+    size_t len = 0;
+    std::chrono::steady_clock::time_point start;
+
+    // live pointer => pointer ID
+    std::unordered_map<void*, uint32_t> ids;
+    uint32_t next_id = 1;
+    // site ID => whether an M61_TRACE_SITE record has defined it
+    std::vector<bool> sites_defined;
+
+    void append(const void* data, size_t sz);
+    void flush();
+};
+
+static m61_trace_writer* trace_writer;
+static std::mutex trace_lock;   // remote frees trace from other threads
+static std::atomic<int> trace_state = -1;  // -1 unknown, 0 off, 1 on
+static std::once_flag trace_once;
+
+
+void m61_trace_writer::append(const void* data, size_t sz) {
+    if (this->len + sz > sizeof(this->buf)) {
+        this->flush();
+    }
+    memcpy(&this->buf[this->len], data, sz);
+    this->len += sz;
+}
+
+void m61_trace_writer::flush() {
+    size_t off = 0;
+    while (off != this->len) {
+        ssize_t w = write(this->fd, &this->buf[off], this->len - off);
+        if (w <= 0) {
+            break;
+        }
+        off += w;
+    }
+    this->len = 0;
+}
+
+static void m61_trace_init() {
+    const char* path = getenv("M61_TRACE");
+    int fd = path && *path ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666) : -1;
+    if (fd < 0) {
+        if (path && *path) {
+            fprintf(stderr, "m61: cannot open trace file %s\n", path);
+        }
+        trace_state = 0;
+        return;
+    }
+
+    trace_writer = new m61_trace_writer;
+    trace_writer->fd = fd;
+    trace_writer->start = std::chrono::steady_clock::now();
+
+    m61_trace_header h;
+    memcpy(h.magic, m61_trace_magic, sizeof(h.magic));
+    h.version = m61_trace_version;
+    h.record_size = sizeof(m61_trace_record);
+    trace_writer->append(&h, sizeof(h));
+
+    atexit(m61_trace_flush);
+    trace_state = 1;
+}
+
+bool m61_trace_enabled() {
+    int state = trace_state.load(std::memory_order_relaxed);
+    if (state < 0) {
+        std::call_once(trace_once, m61_trace_init);
+        state = trace_state.load(std::memory_order_relaxed);
+    }
+    return state > 0;
+}
+
+void m61_trace(m61_trace_op op, void* ptr, uint64_t size, const char* file, int line) {
+    // release builds pass no call site
+    file = file ? file : "?";
+    std::lock_guard<std::mutex> guard(trace_lock);
+    m61_trace_writer* tw = trace_writer;
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - tw->start).count();
+
+    // define the call site on its first use in the trace
+    uint32_t site = m61_site_intern(file, line);
+    if (site >= tw->sites_defined.size()) {
+        tw->sites_defined.resize(site + 1);
+    }
+    if (site != 0 && !tw->sites_defined[site]) {
+        tw->sites_defined[site] = true;
+        size_t namelen = strlen(file);
+        m61_trace_record sr = {M61_TRACE_SITE, site, 0, (uint64_t) line, namelen};
+        tw->append(&sr, sizeof(sr));
+        tw->append(file, namelen);
+    }
+
+    // number the pointer
+    uint32_t id = 0;
+    if (ptr && op == M61_TRACE_FREE) {
+        auto it = tw->ids.find(ptr);
+        if (it != tw->ids.end()) {
+            id = it->second;
+            tw->ids.erase(it);
+        }
+    } else if (ptr) {
+        id = tw->next_id;
+        ++tw->next_id;
+        tw->ids[ptr] = id;
+    }
+
+    m61_trace_record r = {op, id, site, size, now};
+    tw->append(&r, sizeof(r));
+}
+
+
+/// m61_trace_flush()
+///    Write any buffered trace records to the trace file.
+
+void m61_trace_flush() {
+    std::lock_guard<std::mutex> guard(trace_lock);
+    if (trace_writer) {
+        trace_writer->flush();
+    }
+}
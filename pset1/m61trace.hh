@@ -0,0 +1,58 @@
+#ifndef M61TRACE_HH
+#define M61TRACE_HH 1
+#include <cinttypes>
+#include <cstddef>
+
+/// m61 allocation traces
+///    Setting the environment variable `M61_TRACE=PATH` makes every
+///    m61_malloc, m61_calloc and m61_free append a record to the binary
+///    trace file PATH. `m61replay` plays a trace back against any m61 build.
+///
+///    A trace is an m61_trace_header followed by m61_trace_records. Calls
+///    name their site by its m61_site_intern() ID: before the first
+///    operation from a site, an M61_TRACE_SITE record defines it (`id` is
+///    the site ID, `size` the line, `time` the length of the file name,
+///    which follows the record). Site ID 0, never defined, is unknown.
+///    Pointers are numbered in allocation order starting from 1; ID 0 is
+///    `nullptr`, so failed allocations and `m61_free(nullptr)` carry ID 0.
+///    Allocations made with exclusive placement (m61_malloc_exclusive(), or
+///    any allocation while m61_set_exclusive() is on) have the
+///    M61_TRACE_EXCLUSIVE flag set in `op`.
+
+enum m61_trace_op : uint8_t {
+    M61_TRACE_MALLOC = 1,
+    M61_TRACE_CALLOC = 2,       // `size` is count * sz, or UINT64_MAX on overflow
+    M61_TRACE_FREE = 3,
+    M61_TRACE_SITE = 4,
+    M61_TRACE_EXCLUSIVE = 0x80  // flag on MALLOC and CALLOC: exclusive placement
+};
+
+struct m61_trace_header {
+    char magic[8];              // "m61trace"
+    uint32_t version;
+    uint32_t record_size;       // sizeof(m61_trace_record)
+};
+
+struct __attribute__((packed)) m61_trace_record {
+    uint8_t op;                 // m61_trace_op, possibly | M61_TRACE_EXCLUSIVE
+    uint32_t id;                // pointer ID (site ID for M61_TRACE_SITE)
+    uint32_t site;              // site ID of the call
+    uint64_t size;              // bytes requested
+    uint64_t time;              // nanoseconds since the trace started
+};
+
+static constexpr char m61_trace_magic[8] = {'m', '6', '1', 't', 'r', 'a', 'c', 'e'};
+// version 1 traces are valid version 2 traces without exclusive flags
+static constexpr uint32_t m61_trace_version = 2;
+
+
+/// m61_trace_enabled()
+///    Return true if allocator calls are being traced.
+bool m61_trace_enabled();
+
+/// m61_trace(op, ptr, size, file, line)
+///    Append a record for an m61 call to the trace. `ptr` is the block
+///    returned by (or passed to) the call.
+void m61_trace(m61_trace_op op, void* ptr, uint64_t size, const char* file, int line);
+
+#endif
@@ -0,0 +1,31 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <thread>
+// Check that blocks freed by another thread are reclaimed by the owner.
+
+int main() {
+    constexpr int nptrs = 1000;
+    void* ptrs[nptrs];
+    for (int round = 0; round != 20; ++round) {
+        for (int i = 0; i != nptrs; ++i) {
+            ptrs[i] = m61_malloc(400);
+            assert(ptrs[i]);
+            memset(ptrs[i], round, 400);
+        }
+
+        // a consumer thread frees everything the producer allocated
+        std::thread consumer([&] () {
+            for (int i = 0; i != nptrs; ++i) {
+                m61_free(ptrs[i]);
+            }
+        });
+        consumer.join();
+    }
+
+    m61_print_statistics();
+}
+
+//! alloc count: active          0   total      20000   fail          0
+//! alloc size:  active          0   total    8000000   fail          0
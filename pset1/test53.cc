@@ -0,0 +1,64 @@
+#include "m61.hh"
+#include "m61trace.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+// Check that M61_TRACE records every allocator call.
+
+int main() {
+    char path[] = "/tmp/m61trace.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    setenv("M61_TRACE", path, 1);
+
+    void* a = m61_malloc(10);
+    void* b = m61_calloc(4, 8);
+    m61_free(a);
+    void* c = m61_malloc(size_t(16) << 20);
+    assert(!c);
+    m61_free(b);
+    m61_free(nullptr);
+    void* d = m61_malloc_exclusive(24);
+    m61_free(d);
+    m61_trace_flush();
+
+    FILE* f = fopen(path, "rb");
+    assert(f);
+    m61_trace_header h;
+    assert(fread(&h, sizeof(h), 1, f) == 1);
+    assert(memcmp(h.magic, m61_trace_magic, sizeof(h.magic)) == 0);
+    assert(h.record_size == sizeof(m61_trace_record));
+
+    const char* names[] = {"?", "malloc", "calloc", "free", "site"};
+    std::vector<int> lines(1, 0);
+    uint64_t last_time = 0;
+    m61_trace_record r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        if (r.op == M61_TRACE_SITE) {
+            char name[256] = "";
+            assert(r.time < sizeof(name) && fread(name, 1, r.time, f) == r.time);
+            assert(strcmp(name, "test53.cc") == 0);
+            lines.push_back(r.size);
+            continue;
+        }
+        assert(r.time >= last_time);
+        last_time = r.time;
+        printf("%s%s id %u size %llu line %d\n", names[r.op & ~M61_TRACE_EXCLUSIVE],
+               r.op & M61_TRACE_EXCLUSIVE ? " exclusive" : "", r.id,
+               (unsigned long long) r.size, lines[r.site]);
+    }
+    fclose(f);
+    unlink(path);
+}
+
+//! malloc id 1 size 10 line 17
+//! calloc id 2 size 32 line 18
+//! free id 1 size 0 line 19
+//! malloc id 0 size 16777216 line 20
+//! free id 2 size 0 line 22
+//! free id 0 size 0 line 23
+//! malloc exclusive id 3 size 24 line 24
+//! free id 3 size 0 line 25
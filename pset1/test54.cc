@@ -0,0 +1,49 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check free-space, padding, and metadata statistics.
+
+int main() {
+    void* ptrs[10];
+    for (int i = 0; i != 10; ++i) {
+        ptrs[i] = m61_malloc(100);
+        assert(ptrs[i]);
+    }
+    m61_statistics stat = m61_get_statistics();
+    printf("padding %llu, free blocks %llu\n", stat.padding_size, stat.nfree);
+    size_t heap_size = stat.free_size + 10 * 112;
+
+    // free every other block: five 112-byte holes
+    for (int i = 0; i != 10; i += 2) {
+        m61_free(ptrs[i]);
+    }
+    stat = m61_get_statistics();
+    printf("padding %llu, free blocks %llu, used %llu\n", stat.padding_size,
+           stat.nfree, heap_size - stat.free_size);
+    assert(stat.largest_free == heap_size - 10 * 112);
+    assert(stat.fragmentation > 0 && stat.fragmentation < 0.001);
+    assert(stat.metadata_size > 0);
+    unsigned long long metadata = stat.metadata_size;
+
+    // new blocks come from unused heap and carry no padding
+    void* a = m61_malloc(112);
+    void* b = m61_malloc(48);
+    stat = m61_get_statistics();
+    printf("padding %llu, free blocks %llu, used %llu\n", stat.padding_size,
+           stat.nfree, heap_size - stat.free_size);
+    assert(stat.metadata_size > metadata);
+
+    m61_free(a);
+    m61_free(b);
+    for (int i = 1; i < 10; i += 2) {
+        m61_free(ptrs[i]);
+    }
+    stat = m61_get_statistics();
+    printf("padding %llu, active %llu\n", stat.padding_size, stat.nactive);
+}
+
+//! padding 120, free blocks 1
+//! padding 60, free blocks 6, used 560
+//! padding 60, free blocks 6, used 720
+//! padding 0, active 0
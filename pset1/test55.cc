@@ -0,0 +1,50 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check size and lifetime histograms in the JSON statistics dump.
+
+int main() {
+    // 4 blocks of 1-byte, 3 of 100 bytes, 1 of 5000 bytes
+    void* ptrs[8];
+    for (int i = 0; i != 4; ++i) {
+        ptrs[i] = m61_malloc(1);
+    }
+    for (int i = 4; i != 7; ++i) {
+        ptrs[i] = m61_malloc(100);
+    }
+    ptrs[7] = m61_calloc(50, 100);
+
+    // lifetimes: ptrs[7] lives 1 epoch, ptrs[0] lives 8
+    m61_free(ptrs[7]);
+    m61_free(ptrs[0]);
+    m61_dump_stats_json(stdout);
+}
+
+//! {
+//!   "nactive": 6,
+//!   "active_size": 303,
+//!   "ntotal": 8,
+//!   "total_size": 5304,
+//!   "nfail": 0,
+//!   "fail_size": 0,
+//!   "heap_min": ??{\d+}??,
+//!   "heap_max": ??{\d+}??,
+//!   "free_size": ??{\d+}??,
+//!   "nfree": 3,
+//!   "largest_free": ??{\d+}??,
+//!   "fragmentation": ??{0\.\d+}??,
+//!   "padding_size": 81,
+//!   "metadata_size": ??{\d+}??,
+//!   "lifetime_unit": "allocations",
+//!   "histogram_sampling": 1,
+//!   "size_histogram": [
+//!     {"min": 1, "max": 1, "count": 4},
+//!     {"min": 64, "max": 127, "count": 3},
+//!     {"min": 4096, "max": 8191, "count": 1}
+//!   ],
+//!   "lifetime_histogram": [
+//!     {"min": 1, "max": 1, "count": 1},
+//!     {"min": 8, "max": 15, "count": 1}
+//!   ]
+//! }
@@ -0,0 +1,46 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that m61_heap_walk visits every block in address order.
+
+static int print_block(const m61_block_info* b, void* ctx) {
+    uintptr_t* next = (uintptr_t*) ctx;
+    assert(*next == 0 || (uintptr_t) b->ptr == *next);
+    *next = (uintptr_t) b->ptr + b->footprint;
+    const char* states[] = {"active", "free", "unused", "metadata"};
+    if (b->state == M61_BLOCK_ACTIVE) {
+        printf("%s %zu/%zu %s:%d\n", states[b->state], b->size, b->footprint,
+               b->file, b->line);
+    } else {
+        printf("%s %zu\n", states[b->state], b->size);
+    }
+    return 0;
+}
+
+static int stop_at_free(const m61_block_info* b, void*) {
+    return b->state == M61_BLOCK_FREE ? 2 : 0;
+}
+
+int main() {
+    void* a = m61_malloc(10);
+    void* b = m61_malloc(20);
+    void* c = m61_calloc(3, 16);
+    void* d = m61_malloc(1);
+    m61_free(b);
+    (void) a, (void) c, (void) d;
+
+    uintptr_t next = 0;
+    int r = m61_heap_walk(print_block, &next);
+    m61_statistics stat = m61_get_statistics();
+    assert(r == 0 && next == stat.heap_max);
+
+    printf("stopped %d\n", m61_heap_walk(stop_at_free, nullptr));
+}
+
+//! active 10/16 test56.cc:26
+//! free 32
+//! active 48/48 test56.cc:28
+//! active 1/16 test56.cc:29
+//! unused 8388496
+//! stopped 2
@@ -0,0 +1,55 @@
+#include "m61heap.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check that m61_heap policies control size classes, alignment, and fit.
+
+struct wide_policy : m61_default_policy {
+    static constexpr size_t heap_size = 1 << 20;
+    static constexpr size_t alignment = 64;
+    static constexpr std::array<size_t, 3> size_classes = {64, 256, 1024};
+    static constexpr m61_fit fit = m61_fit::best;
+};
+
+// size classes resolve at compile time
+using wide_classes = m61_size_classes<wide_policy>;
+static_assert(wide_classes::footprint(0) == 64);
+static_assert(wide_classes::footprint(65) == 256);
+static_assert(wide_classes::footprint(1024) == 1024);
+static_assert(wide_classes::footprint(1025) == 1088);
+static_assert(m61_size_classes<m61_default_policy>::footprint(17) == 32);
+static_assert(m61_size_classes<m61_fast_policy>::footprint(129) == 256);
+
+int main() {
+    static m61_heap<wide_policy> heap;
+
+    // alignment and class rounding
+    char* p[6];
+    for (int i = 0; i != 6; ++i) {
+        p[i] = (char*) heap.allocate(i % 2 ? 1000 : 10, "test57.cc", __LINE__);
+        assert(p[i] && (uintptr_t) p[i] % 64 == 0);
+    }
+    assert(p[1] - p[0] == 64 && p[2] - p[1] == 1024);
+
+    // fill the rest of the heap so reuse must come from the free list
+    m61_statistics stat = heap.statistics();
+    void* rest = heap.allocate(stat.free_size, "test57.cc", __LINE__);
+    assert(rest);
+
+    // best fit: a 40-byte request takes the 64-byte hole, not the 1024-byte one
+    heap.free(p[1], "test57.cc", __LINE__);
+    heap.free(p[4], "test57.cc", __LINE__);
+    void* q = heap.allocate(40, "test57.cc", __LINE__);
+    assert(q == p[4]);
+
+    stat = heap.statistics();
+    printf("active %llu, padding %llu, free %llu\n",
+           stat.nactive, stat.padding_size, stat.free_size);
+
+    // the default heap is independent
+    void* r = m61_malloc(10);
+    assert(!heap.contains(r));
+    m61_free(r);
+}
+
+//! active 6, padding 180, free 1024
@@ -0,0 +1,81 @@
+#include "m61region.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+// Check that a file-backed region keeps its data structures across a
+// close and reopen at a different address, and that a region too big to
+// map is an error, not a crash.
+
+struct node {
+    int value;
+    m61_offset_ptr<node> next;
+};
+
+int main() {
+    char path[] = "/tmp/m61region.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    m61_region* r = m61_region_open(path, 1 << 20);
+    assert(r);
+    assert(m61_region_root(r) == nullptr);
+    node* head = nullptr;
+    for (int i = 0; i < 5; ++i) {
+        node* n = (node*) m61_region_malloc(r, sizeof(node));
+        new (n) node{i * 10, head};
+        head = n;
+    }
+    m61_region_set_root(r, head);
+    // free one node and unlink it
+    node* dead = head->next.get();
+    head->next = dead->next;
+    m61_region_free(r, dead);
+    uintptr_t old_base = (uintptr_t) head;
+    m61_region_close(r);
+
+    // occupy the old address range so the reopened region moves
+    void* blocker = mmap((void*) (old_base & ~uintptr_t(4095)), 4 << 20,
+                         PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    r = m61_region_open(path, 0);
+    assert(r);
+    head = (node*) m61_region_root(r);
+    assert(head);
+    for (node* n = head; n; n = n->next.get()) {
+        printf("%d\n", n->value);
+    }
+    m61_statistics stat = m61_region_get_statistics(r);
+    printf("active %llu, total %llu\n", stat.nactive, stat.ntotal);
+    // sizes count requested bytes, not the rounded block payload
+    void* odd = m61_region_malloc(r, 100);
+    stat = m61_region_get_statistics(r);
+    printf("active size %llu, total size %llu\n", stat.active_size, stat.total_size);
+    m61_region_free(r, odd);
+    stat = m61_region_get_statistics(r);
+    printf("active size %llu, total size %llu\n", stat.active_size, stat.total_size);
+    m61_region_close(r);
+    munmap(blocker, 4 << 20);
+    unlink(path);
+
+    char big_path[] = "/tmp/m61region.XXXXXX";
+    fd = mkstemp(big_path);
+    close(fd);
+    rlimit rl = {size_t(1) << 36, size_t(1) << 36};
+    assert(setrlimit(RLIMIT_AS, &rl) == 0);
+    printf("too big: %s\n", m61_region_open(big_path, size_t(1) << 40) ? "mapped" : "nullptr");
+    unlink(big_path);
+}
+
+//! 40
+//! 20
+//! 10
+//! 0
+//! active 4, total 5
+//! active size 164, total size 180
+//! active size 64, total size 180
+//! too big: nullptr
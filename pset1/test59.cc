@@ -0,0 +1,61 @@
+#include "m61region.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+// Check that forked processes can allocate from and free into one shared
+// region, and hand blocks to each other by offset.
+
+int main() {
+    m61_region* r = m61_region_create_shared(1 << 20);
+    assert(r);
+    char* mine[3];
+    for (int i = 0; i != 3; ++i) {
+        mine[i] = (char*) m61_region_malloc(r, 100);
+    }
+
+    int pfd[2];
+    int rv = pipe(pfd);
+    assert(rv == 0);
+    for (int i = 0; i != 3; ++i) {
+        if (fork() == 0) {
+            close(pfd[0]);
+            // free a block the parent allocated, contend for the lock a bit
+            m61_region_free(r, mine[i]);
+            for (int j = 0; j != 1000; ++j) {
+                m61_region_free(r, m61_region_malloc(r, 8 + j % 200));
+            }
+            // hand the parent a filled buffer
+            char* buf = (char*) m61_region_malloc(r, 4096);
+            memset(buf, 'a' + i, 4096);
+            uint64_t off = m61_region_offset(r, buf);
+            ssize_t w = write(pfd[1], &off, sizeof(off));
+            assert(w == sizeof(off));
+            _exit(0);
+        }
+    }
+    close(pfd[1]);
+    while (wait(nullptr) > 0) {
+    }
+
+    uint64_t off;
+    while (read(pfd[0], &off, sizeof(off)) == sizeof(off)) {
+        char* buf = (char*) m61_region_at(r, off);
+        for (int k = 1; k != 4096; ++k) {
+            assert(buf[k] == buf[0]);
+        }
+        printf("got %c\n", buf[0]);
+        m61_region_free(r, buf);
+    }
+
+    m61_statistics stat = m61_region_get_statistics(r);
+    printf("active %llu, total %llu\n", stat.nactive, stat.ntotal);
+    m61_region_close(r);
+}
+
+//!!UNORDERED
+//! got a
+//! got b
+//! got c
+//! active 0, total 3006
@@ -0,0 +1,57 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <deque>
+// Check soft and hard heap limits and memory-pressure callbacks.
+
+static std::deque<void*> cache;
+static size_t nevicted = 0;
+
+static void evict(size_t want, void*) {
+    // free 512-byte cache entries until `want` bytes are released
+    for (size_t freed = 0; freed < want && !cache.empty(); freed += 512) {
+        m61_free(cache.front());
+        cache.pop_front();
+        ++nevicted;
+    }
+}
+
+int main() {
+    m61_set_heap_limits(4096, 8192);
+
+    // no callbacks: the soft limit alone does not fail allocations
+    for (int i = 0; i != 10; ++i) {
+        cache.push_back(m61_malloc(512));
+        assert(cache.back());
+    }
+    // but the hard limit does
+    assert(!m61_malloc(4096));
+
+    // with a callback, crossing the soft limit evicts instead
+    m61_add_pressure_callback(evict, nullptr);
+    for (int i = 0; i != 10; ++i) {
+        cache.push_back(m61_malloc(512));
+    }
+    m61_statistics stat = m61_get_statistics();
+    printf("evicted %zu, cached %zu, active %llu bytes\n",
+           nevicted, cache.size(), stat.active_size);
+
+    // an allocation over the hard limit gets one more round of relief
+    void* big = m61_malloc(6000);
+    assert(big);
+    printf("evicted %zu, cached %zu\n", nevicted, cache.size());
+
+    assert(m61_remove_pressure_callback(evict, nullptr) == 0);
+    assert(m61_remove_pressure_callback(evict, nullptr) == -1);
+    m61_free(big);
+    while (!cache.empty()) {
+        m61_free(cache.front());
+        cache.pop_front();
+    }
+    m61_print_statistics();
+}
+
+//! evicted 12, cached 8, active 4096 bytes
+//! evicted 20, cached 0
+//! alloc count: active          0   total         21   fail          1
+//! alloc size:  active        ???   total      ??>=10240??   fail       4096
@@ -0,0 +1,49 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+// Check that m61_coalesce_step merges free blocks a bounded number at a time.
+
+int main() {
+    void* p[256];
+    for (int i = 0; i != 256; ++i) {
+        p[i] = m61_malloc(48);
+    }
+    // 32 isolated holes that can never merge
+    for (int i = 0; i < 128; i += 4) {
+        m61_free(p[i]);
+    }
+    // then a run of 64 neighbors, freed scattered; the frees themselves
+    // merge only the blocks near the coalescing cursor
+    for (int i = 160; i < 224; i += 2) {
+        m61_free(p[i]);
+    }
+    for (int i = 223; i > 160; i -= 2) {
+        m61_free(p[i]);
+    }
+    m61_statistics stat = m61_get_statistics();
+    size_t before = stat.nfree;
+    assert(before > 34);
+
+    // each step examines at most 4 blocks
+    size_t n = m61_coalesce_step(4);
+    assert(n <= 4);
+    size_t total = n;
+    // an idle loop: a few sweeps over the free list
+    for (int i = 0; i != 30; ++i) {
+        total += m61_coalesce_step(4);
+    }
+    stat = m61_get_statistics();
+    assert(stat.nfree + total == before);
+    assert(m61_coalesce_step(1000) == 0);
+    // 32 holes, the run, and the unused frontier
+    printf("nfree %llu, largest hole %llu\n", stat.nfree,
+           stat.largest_free < 64 * 48 ? stat.largest_free : 64 * 48);
+
+    for (int i = 0; i != 256; ++i) {
+        if (i >= 128 ? i < 160 || i >= 224 : i % 4 != 0) {
+            m61_free(p[i]);
+        }
+    }
+}
+
+//! nfree 34, largest hole 3072
@@ -0,0 +1,56 @@
+#include "m61heap.hh"
+#include <cstdio>
+#include <cassert>
+// Check that the buddy backend splits blocks in halves and merges buddies.
+
+struct small_buddy_policy : m61_default_policy {
+    static constexpr size_t heap_size = 4096;
+    static constexpr m61_fit fit = m61_fit::buddy;
+};
+
+static int print_block(const m61_block_info* b, void* ctx) {
+    printf(" %s%zu", b->state == M61_BLOCK_ACTIVE ? "A" : "F",
+           (size_t) ((char*) b->ptr - (char*) ctx));
+    return 0;
+}
+
+static m61_heap<small_buddy_policy> heap;
+
+static void print_heap(void* base) {
+    printf("heap:");
+    heap.walk(print_block, base);
+    printf("\n");
+}
+
+int main() {
+    // 100 bytes round up to order 128; the 4096-byte heap splits 5 times
+    char* a = (char*) heap.allocate(100, "test62.cc", __LINE__);
+    assert(a);
+    print_heap(a);
+    char* b = (char*) heap.allocate(16, "test62.cc", __LINE__);
+    char* c = (char*) heap.allocate(600, "test62.cc", __LINE__);
+    assert(b - a == 128 && c - a == 1024);
+    print_heap(a);
+
+    m61_statistics stat = heap.statistics();
+    printf("padding %llu\n", stat.padding_size);
+
+    // freeing a leaves it unmerged: its buddy at 128 is split
+    heap.free(a, "test62.cc", __LINE__);
+    print_heap(a);
+    heap.free(b, "test62.cc", __LINE__);
+    print_heap(a);
+    heap.free(c, "test62.cc", __LINE__);
+    print_heap(a);
+
+    // too big for any block
+    assert(!heap.allocate(4097, "test62.cc", __LINE__));
+    assert(heap.allocate(4096, "test62.cc", __LINE__) == a);
+}
+
+//! heap: A0 F128 F256 F512 F1024 F2048
+//! heap: A0 A128 F144 F160 F192 F256 F512 A1024 F2048
+//! padding 452
+//! heap: F0 A128 F144 F160 F192 F256 F512 A1024 F2048
+//! heap: F0 A1024 F2048
+//! heap: F0
@@ -0,0 +1,51 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+// Check that the conservative leak scan separates leaked blocks from
+// blocks reachable through globals, the stack, other blocks, and handles.
+
+struct node {
+    node* next;
+    char payload[24];
+};
+
+static node* global_list;
+static m61_handle global_handle;
+
+__attribute__((noinline)) static void make_blocks() {
+    // a chain reachable only through a global
+    global_list = (node*) m61_malloc(sizeof(node));
+    global_list->next = (node*) m61_malloc(sizeof(node));
+    global_list->next->next = nullptr;
+
+    // an unreachable cycle
+    node* a = (node*) m61_malloc(sizeof(node));
+    node* b = (node*) m61_malloc(sizeof(node));
+    a->next = b;
+    b->next = a;
+
+    // a block reached only by an interior pointer from the chain
+    char* buf = (char*) m61_malloc(100);
+    global_list->next->next = (node*) (buf + 40);
+
+    // a block reached only through its handle, which is not a pointer
+    global_handle = m61_handle_alloc(50);
+}
+
+int main() {
+    make_blocks();
+    // reachable from the stack
+    void* volatile local = m61_malloc(7);
+    m61_print_leak_report_scan(2);
+    (void) local;
+    m61_handle_free(global_handle);
+}
+
+//! LEAK CHECK: test63.cc:17: reachable object ??? with size 32
+//! LEAK CHECK: test63.cc:18: reachable object ??? with size 32
+//! LEAK CHECK: test63.cc:22: leaked object ??? with size 32
+//! LEAK CHECK: test63.cc:23: leaked object ??? with size 32
+//! LEAK CHECK: test63.cc:28: reachable object ??? with size 100
+//! LEAK CHECK: test63.cc:32: reachable object ??? with size 50
+//! LEAK CHECK: test63.cc:38: reachable object ??? with size 7
+//! LEAK SUMMARY: definitely leaked 2 objects (64 bytes), still reachable 5 objects (221 bytes)
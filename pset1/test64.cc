@@ -0,0 +1,55 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check m61_realloc, and that large calloc and realloc blocks (which take
+// the non-temporal fill and copy paths) are zeroed and copied exactly.
+
+int main() {
+    // small: in place within the footprint, moved beyond it
+    char* p = (char*) m61_malloc(13);
+    strcpy(p, "hello");
+    assert(m61_realloc(p, 14) == p);
+    char* q = (char*) m61_realloc(p, 100);
+    assert(q != p && strcmp(q, "hello") == 0);
+    q = (char*) m61_realloc(q, 3);
+    assert(q && memcmp(q, "hel", 3) == 0);
+    m61_free(q);
+
+    // large calloc reusing dirty memory; odd size exercises head and tail
+    const size_t big = (3 << 20) + 3;
+    unsigned char* a = (unsigned char*) m61_malloc(big);
+    memset(a, 0xAB, big);
+    void* b = m61_malloc(3 << 20);
+    m61_free(a);
+    unsigned char* c = (unsigned char*) m61_calloc(1, big);
+    assert(c && c <= a && a < c + big);   // reuses the dirty memory
+    size_t nonzero = 0;
+    for (size_t i = 0; i != big; ++i) {
+        nonzero += c[i] != 0;
+    }
+    printf("calloc: %zu nonzero bytes\n", nonzero);
+    m61_free(b);
+    m61_free(c);
+
+    // large realloc copy, from an unaligned source offset
+    const size_t n = (2 << 20) + 5;
+    unsigned char* r = (unsigned char*) m61_malloc(n);
+    for (size_t i = 0; i != n; ++i) {
+        r[i] = (unsigned char) (i * 7 + i / 251);
+    }
+    unsigned char* s = (unsigned char*) m61_realloc(r, (3 << 20) + 1);
+    assert(s && s != r);
+    size_t bad = 0;
+    for (size_t i = 0; i != n; ++i) {
+        bad += s[i] != (unsigned char) (i * 7 + i / 251);
+    }
+    printf("realloc: %zu bad bytes\n", bad);
+    m61_free(s);
+    m61_print_statistics();
+}
+
+//! calloc: 0 nonzero bytes
+//! realloc: 0 bad bytes
+//! alloc count: active          0   total          8   fail          0
+//! alloc size:  active        ???   total   ??>=0??   fail          0
@@ -0,0 +1,45 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <thread>
+// Check that profiling counts operations per type, across threads, and
+// only while enabled.
+
+static void churn(int n) {
+    for (int i = 0; i != n; ++i) {
+        m61_free(m61_malloc(i + 1));
+    }
+}
+
+int main() {
+    churn(10);              // not profiled
+    m61_profile_enable(true);
+    churn(100);
+    std::thread t(churn, 50);
+    t.join();
+    m61_free(m61_calloc(4, 8));
+    m61_free(m61_realloc(nullptr, 10));
+    m61_profile_enable(false);
+    churn(10);
+
+    char* buf;
+    size_t len;
+    FILE* f = open_memstream(&buf, &len);
+    m61_dump_profile_json(f);
+    fclose(f);
+    // print the counts only; the histograms depend on timing
+    for (char* line = strtok(buf, "\n"); line; line = strtok(nullptr, "\n")) {
+        if (strstr(line, "_count") || strstr(line, "unit")) {
+            printf("%s\n", line);
+        }
+    }
+    free(buf);
+}
+
+//!   "unit": "??{cycles|ns}??",
+//!   "malloc_count": 150,
+//!   "free_count": 152,
+//!   "calloc_count": 1,
+//!   "realloc_count": 1,
+//!   "coalesce_count": ??{\d+}??,
@@ -0,0 +1,66 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <sys/mman.h>
+// Check that the background maintenance thread returns the pages of large
+// free blocks to the OS while the application keeps allocating.
+
+static size_t resident_pages(void* ptr, size_t sz) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t) ptr + page - 1) & ~(page - 1);
+    uintptr_t last = ((uintptr_t) ptr + sz) & ~(page - 1);
+    unsigned char vec[1024];
+    assert((last - first) / page <= sizeof(vec));
+    int r = mincore((void*) first, last - first, vec);
+    assert(r == 0);
+    size_t n = 0;
+    for (size_t i = 0; i != (last - first) / page; ++i) {
+        n += vec[i] & 1;
+    }
+    return n;
+}
+
+int main() {
+    m61_maintenance_start(1);
+
+    const size_t sz = 1 << 20;
+    char* big[3];
+    for (int i = 0; i != 3; ++i) {
+        big[i] = (char*) m61_malloc(sz);
+        memset(big[i], 'x', sz);
+    }
+    m61_free(big[1]);
+    printf("resident after free: %s\n", resident_pages(big[1], sz) > 200 ? "most" : "few");
+
+    // keep allocating while maintenance runs
+    for (int round = 0; round != 200; ++round) {
+        void* p[16];
+        for (int i = 0; i != 16; ++i) {
+            p[i] = m61_malloc(100 + i);
+            assert(p[i]);
+        }
+        for (int i = 0; i != 16; ++i) {
+            m61_free(p[i]);
+        }
+        usleep(100);
+    }
+    printf("resident after maintenance: %zu\n", resident_pages(big[1], sz));
+
+    // the trimmed block is still usable
+    m61_statistics stat = m61_get_statistics();
+    m61_maintenance_stop();
+    char* again = (char*) m61_malloc(sz - 4096);
+    assert(again);
+    memset(again, 'y', sz - 4096);
+    m61_free(again);
+    m61_free(big[0]);
+    m61_free(big[2]);
+    printf("active %llu\n", stat.nactive - 2);
+}
+
+//! resident after free: most
+//! resident after maintenance: 0
+//! active 0
@@ -0,0 +1,28 @@
+#include "m61stress.hh"
+#include <cstdio>
+#include <cassert>
+// Run the differential stress engine over a fixed seed: every block's
+// contents, placement and statistics must agree with the reference model,
+// and the same seed must replay the same sequence.
+
+int main() {
+    m61_stress_config config;
+    config.seed = 42;
+    config.ops = 20000;
+    config.max_size = 20000;
+    m61_stress_result r1 = m61_stress(config).run();
+    assert(r1.ops() == config.ops);
+    printf("errors %zu\n", r1.errors);
+
+    m61_stress_result r2 = m61_stress(config).run();
+    assert(r2.nmalloc == r1.nmalloc && r2.ncalloc == r1.ncalloc
+           && r2.nrealloc == r1.nrealloc && r2.nfree == r1.nfree);
+    printf("errors %zu\n", r2.errors);
+
+    m61_statistics stat = m61_get_statistics();
+    printf("active %llu\n", stat.nactive);
+}
+
+//! errors 0
+//! errors 0
+//! active 0
@@ -0,0 +1,89 @@
+#include "m61heap.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <set>
+// Check compact headers: 8-byte in-band headers, and headerless slab slots
+// for blocks of at most 16 bytes.
+
+struct small_compact_policy : m61_compact_policy {
+    static constexpr size_t heap_size = 1 << 16;
+};
+
+static m61_heap<small_compact_policy> heap;
+
+static int count_block(const m61_block_info* b, void* ctx) {
+    size_t* counts = (size_t*) ctx;
+    if (b->state == M61_BLOCK_FREE) {
+        ++counts[0];
+    } else if (b->state == M61_BLOCK_ACTIVE && strcmp(b->file, "test68.cc") == 0) {
+        ++counts[1];
+    } else if (b->state == M61_BLOCK_METADATA) {
+        ++counts[2];
+    }
+    return 0;
+}
+
+static void print_walk() {
+    size_t counts[3] = {0, 0, 0};
+    heap.walk(count_block, counts);
+    printf("walk: %zu free, %zu with site, %zu slab metadata\n", counts[0], counts[1], counts[2]);
+}
+
+int main() {
+    // a 20-byte block takes 32 bytes, header included
+    char* a = (char*) heap.allocate(20, "test68.cc", __LINE__);
+    char* b = (char*) heap.allocate(20, "test68.cc", __LINE__);
+    assert(a && b && (uintptr_t) a % 16 == 0);
+    printf("20-byte stride %zu\n", (size_t) (b - a));
+
+    // tiny blocks fill 16-byte slots, 201 to a page
+    char* t[300];
+    std::set<uintptr_t> pages;
+    for (int i = 0; i != 300; ++i) {
+        t[i] = (char*) heap.allocate(i % 17, "test68.cc", __LINE__);
+        assert(t[i] && (uintptr_t) t[i] % 16 == 0);
+        memset(t[i], i, i % 17);
+        pages.insert((uintptr_t) t[i] / 4096);
+    }
+    printf("tiny stride %zu, %zu pages\n", (size_t) (t[1] - t[0]), pages.size());
+
+    m61_statistics stat = heap.statistics();
+    printf("active %llu, metadata per block %llu\n", stat.nactive,
+           stat.metadata_size / stat.nactive);
+    print_walk();
+
+    // a freed slot is reused
+    heap.free(t[5], "test68.cc", __LINE__);
+    char* t5 = (char*) heap.allocate(3, "test68.cc", __LINE__);
+    assert(t5 == t[5]);
+    heap.free(t5, "test68.cc", __LINE__);
+    t[5] = nullptr;
+
+    // growing within a slot or footprint stays put; past it, moves
+    char* c = (char*) heap.reallocate(t[16], 1, "test68.cc", __LINE__);
+    assert(c == t[16]);
+    c = (char*) heap.reallocate(b, 24, "test68.cc", __LINE__);
+    assert(c == b);
+    c = (char*) heap.reallocate(t[16], 100, "test68.cc", __LINE__);
+    assert(c != t[16] && c[0] == 16);
+    t[16] = c;
+
+    // freeing everything returns the emptied slabs but one
+    heap.free(a, "test68.cc", __LINE__);
+    heap.free(b, "test68.cc", __LINE__);
+    for (int i = 0; i != 300; ++i) {
+        heap.free(t[i], "test68.cc", __LINE__);
+    }
+    stat = heap.statistics();
+    printf("active %llu (%llu bytes), padding %llu\n", stat.nactive, stat.active_size,
+           stat.padding_size);
+    print_walk();
+}
+
+//! 20-byte stride 32
+//! tiny stride 16, 2 pages
+//! active 302, metadata per block 6
+//! walk: 2 free, 302 with site, 4 slab metadata
+//! active 0 (0 bytes), padding 0
+//! walk: ??{[1-9]}?? free, 0 with site, 2 slab metadata
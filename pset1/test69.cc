@@ -0,0 +1,69 @@
+#include "m61.hh"
+#include "m61site.hh"
+#include <cstdio>
+#include <cassert>
+#include <thread>
+#include <vector>
+// Check the interned site table: one ID per (file, line), agreed on by
+// racing threads, and per-site statistics aggregated by ID.
+
+static const char* const this_file = "test69.cc";
+static const char* const other_file = "other.cc";
+
+int main() {
+    uint32_t a = m61_site_intern(this_file, 1);
+    uint32_t b = m61_site_intern(this_file, 2);
+    assert(a != 0 && b != 0 && a != b);
+    assert(m61_site_intern(this_file, 1) == a);
+    assert(m61_site_intern(nullptr, 1) == 0);
+    // sites are keyed by name, not by pointer
+    static char copy[] = "test69.cc";
+    assert(m61_site_intern(copy, 1) == a);
+    printf("%s:%d\n", m61_site_file(b), m61_site_line(b));
+    printf("%s:%d\n", m61_site_file(0), m61_site_line(0));
+
+    // threads intern the same new sites at once and must agree
+    const int nthreads = 4, nsites = 2000;
+    std::vector<std::vector<uint32_t>> ids(nthreads, std::vector<uint32_t>(nsites));
+    std::vector<std::thread> threads;
+    for (int t = 0; t != nthreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i != nsites; ++i) {
+                int line = t % 2 ? i : nsites - 1 - i;
+                ids[t][line] = m61_site_intern(other_file, line);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    for (int i = 0; i != nsites; ++i) {
+        assert(ids[0][i] != 0 && m61_site_line(ids[0][i]) == i);
+        for (int t = 1; t != nthreads; ++t) {
+            assert(ids[t][i] == ids[0][i]);
+        }
+    }
+    printf("sites agree\n");
+
+    // blocks report their site's ID
+    void* p[5];
+    for (int i = 0; i != 3; ++i) {
+        p[i] = m61_malloc(100, this_file, 50);
+    }
+    p[3] = m61_malloc(1000, this_file, 60);
+    p[4] = m61_malloc(10, other_file, 7);
+    m61_print_site_statistics();
+    for (int i = 0; i != 5; ++i) {
+        m61_free(p[i]);
+    }
+    m61_print_site_statistics();
+    printf("done\n");
+}
+
+//! test69.cc:2
+//! ?:0
+//! sites agree
+//! SITE: test69.cc:60: 1 active objects, 1000 bytes
+//! SITE: test69.cc:50: 3 active objects, 300 bytes
+//! SITE: other.cc:7: 1 active objects, 10 bytes
+//! done
@@ -0,0 +1,74 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+// Check relocatable handles: m61_compact() slides unpinned handle blocks
+// into the holes below them, leaves pinned and m61_malloc blocks alone,
+// and returns the emptied tail of the heap.
+
+int main() {
+    char* fixed = (char*) m61_malloc(1000);
+    memset(fixed, 'F', 1000);
+
+    const int n = 100;
+    const size_t sz = 10000;
+    m61_handle h[n];
+    for (int i = 0; i != n; ++i) {
+        h[i] = m61_handle_alloc(sz);
+        assert(h[i]);
+        char* p = (char*) m61_pin(h[i]);
+        memset(p, i, sz);
+        m61_unpin(h[i]);
+    }
+    // punch holes, and pin one block in the middle
+    for (int i = 0; i < n; i += 2) {
+        m61_handle_free(h[i]);
+        h[i] = 0;
+    }
+    char* pinned = (char*) m61_pin(h[51]);
+    char* before[n];
+    for (int i = 1; i < n; i += 2) {
+        before[i] = (char*) m61_pin(h[i]);
+        m61_unpin(h[i]);
+    }
+    m61_statistics stat = m61_get_statistics();
+    printf("before: %llu free blocks\n", stat.nfree);
+
+    size_t released = m61_compact();
+    printf("released %zu\n", released);
+
+    int moved = 0;
+    for (int i = 1; i < n; i += 2) {
+        char* p = (char*) m61_pin(h[i]);
+        moved += p != before[i];
+        for (size_t j = 0; j != sz; ++j) {
+            assert(p[j] == (char) i);
+        }
+        m61_unpin(h[i]);
+    }
+    assert(m61_pin(h[51]) == pinned);
+    m61_unpin(h[51]);
+    m61_unpin(h[51]);
+    for (int i = 0; i != 1000; ++i) {
+        assert(fixed[i] == 'F');
+    }
+    stat = m61_get_statistics();
+    printf("moved %d, %llu active, %llu free blocks\n", moved, stat.nactive, stat.nfree);
+
+    // unpinned, the middle block slides down into the last hole too
+    released = m61_compact();
+    char* p = (char*) m61_pin(h[51]);
+    printf("released %zu, moved %d\n", released, p < pinned);
+    m61_unpin(h[51]);
+    printf("released %zu\n", m61_compact());
+    for (int i = 1; i < n; i += 2) {
+        m61_handle_free(h[i]);
+    }
+    m61_free(fixed);
+}
+
+//! before: 51 free blocks
+//! released ??>=450000??
+//! moved 49, 51 active, 2 free blocks
+//! released ??>=8192??, moved 1
+//! released 0
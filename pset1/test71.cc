@@ -0,0 +1,82 @@
+#include "m61.hh"
+#include "m61heapdump.hh"
+#include "hexdump.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+// Check heap dumps: every block is recorded with its site and contents,
+// and an asynchronous dump sees the heap as it was at the fork.
+
+static const char* const this_file = "test71.cc";
+
+int main() {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/m61test71-%d.dump", (int) getpid());
+
+    char* p[10];
+    for (int i = 0; i != 10; ++i) {
+        p[i] = (char*) m61_malloc(100 + i, this_file, i < 6 ? 10 : 20);
+        memset(p[i], 'a' + i, 100 + i);
+    }
+    m61_free(p[3]);
+    strcpy(p[0], "hello, dump");
+
+    assert(m61_heap_dump(path, M61_DUMP_CONTENTS) == 0);
+    m61_dump d;
+    assert(d.load(path));
+    assert(d.header.pid == (uint32_t) getpid());
+    size_t nactive = 0, nfree = 0;
+    for (auto& b : d.blocks) {
+        if (b.kind == M61_DUMP_ACTIVE) {
+            ++nactive;
+            const char* data = d.contents_of(b);
+            assert(data && memcmp(data, (char*) b.addr, b.size) == 0);
+            printf("%s:%d %zu\n", d.site_of(b).file.c_str(), d.site_of(b).line,
+                   (size_t) b.size);
+        } else if (b.kind == M61_DUMP_FREE) {
+            ++nfree;
+        }
+    }
+    printf("%zu active, %zu free\n", nactive, nfree);
+    fhexdump_at(stdout, 0, d.contents_of(d.blocks[0]), 16);
+
+    // an asynchronous dump is not disturbed by later writes
+    pid_t child = m61_heap_dump(path, M61_DUMP_CONTENTS | M61_DUMP_ASYNC);
+    assert(child > 0);
+    strcpy(p[0], "overwritten");
+    m61_free(p[9]);
+    int status;
+    assert(waitpid(child, &status, 0) == child && WIFEXITED(status)
+           && WEXITSTATUS(status) == 0);
+    assert(d.load(path));
+    printf("%.11s, %zu blocks\n", d.contents_of(d.blocks[0]), d.blocks.size());
+
+    // without contents
+    assert(m61_heap_dump(path) == 0);
+    assert(d.load(path) && d.contents_of(d.blocks[0]) == nullptr);
+    assert(m61_heap_dump("/nonexistent/m61.dump") == -1);
+    unlink(path);
+
+    for (int i = 0; i != 9; ++i) {
+        if (i != 3) {
+            m61_free(p[i]);
+        }
+    }
+    printf("done\n");
+}
+
+//! test71.cc:10 100
+//! test71.cc:10 101
+//! test71.cc:10 102
+//! test71.cc:10 104
+//! test71.cc:10 105
+//! test71.cc:20 106
+//! test71.cc:20 107
+//! test71.cc:20 108
+//! test71.cc:20 109
+//! 9 active, 1 free
+//! 00000000  68 65 6c 6c 6f 2c 20 64  75 6d 70 00 61 61 61 61  |hello, dump.aaaa|
+//! hello, dump, ??>=11?? blocks
+//! done
@@ -0,0 +1,47 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <vector>
+// Check adaptive fit: a size range whose first-fit searches run long
+// switches to best fit, probes first fit again later, and backs off.
+
+int main() {
+    // fill the heap with small blocks, then punch small holes in its lower
+    // half and one large hole in the middle
+    std::vector<void*> ptrs;
+    while (void* p = m61_malloc(64)) {
+        ptrs.push_back(p);
+    }
+    size_t n = ptrs.size();
+    for (size_t i = 1; i < n / 2; i += 2) {
+        m61_free(ptrs[i]);
+        ptrs[i] = nullptr;
+    }
+    for (size_t i = n / 2; i != n / 2 + 200; ++i) {
+        m61_free(ptrs[i]);
+        ptrs[i] = nullptr;
+    }
+
+    // every 1000-byte request must pass the small holes under first fit
+    m61_statistics before = m61_get_statistics();
+    for (int i = 0; i != 640; ++i) {
+        void* p = m61_malloc(1000);
+        assert(p);
+        m61_free(p);
+    }
+    m61_statistics after = m61_get_statistics();
+    // windows of 64: first fit, 4 of best fit, a first-fit probe, best fit
+    printf("switches %llu\n", after.fit_switches - before.fit_switches);
+    unsigned long long holes = n / 4;
+    assert(after.search_steps - before.search_steps <= 2 * 64 * (holes + 10));
+    assert(after.nfreelist - before.nfreelist == 640);
+    printf("searches %s\n", after.search_steps - before.search_steps < 640 * holes
+           ? "shortened" : "long");
+
+    for (void* p : ptrs) {
+        m61_free(p);
+    }
+}
+
+//! switches 3
+//! searches shortened
@@ -0,0 +1,160 @@
+#include "m61heap.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstring>
+#include <thread>
+#include <vector>
+// Check exclusive placement: exclusive blocks own whole cache lines, whether
+// carved from the frontier or from free blocks, in both block layouts, and
+// a thread's exclusive mode applies to all of its allocations.
+
+struct small_policy : m61_default_policy {
+    static constexpr size_t heap_size = 1 << 16;
+};
+struct small_compact_policy : m61_compact_policy {
+    static constexpr size_t heap_size = 1 << 16;
+};
+
+struct walk_state {
+    std::vector<std::pair<uintptr_t, uintptr_t>> active;    // [start, end)
+};
+
+static int collect(const m61_block_info* b, void* ctx) {
+    if (b->state == M61_BLOCK_ACTIVE) {
+        uintptr_t p = (uintptr_t) b->ptr;
+        ((walk_state*) ctx)->active.push_back({p, p + std::max(b->size, size_t(1))});
+    }
+    return 0;
+}
+
+// every block in `excl` starts on a line, and no other active block
+// touches its lines
+template <typename W>
+static bool lines_exclusive(W walk, const std::vector<std::pair<void*, size_t>>& excl) {
+    walk_state ws;
+    walk(collect, &ws);
+    for (auto [ptr, sz] : excl) {
+        uintptr_t lo = (uintptr_t) ptr;
+        uintptr_t hi = lo + ((std::max(sz, size_t(1)) + 63) & ~size_t(63));
+        if (lo % 64 != 0) {
+            return false;
+        }
+        for (auto [start, end] : ws.active) {
+            if (start != lo && start < hi && end > lo) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Heap>
+static void check_heap(const char* name) {
+    Heap* heap = new Heap;
+    auto walk = [heap] (auto callback, void* ctx) { return heap->walk(callback, ctx); };
+    std::vector<std::pair<void*, size_t>> excl;
+    std::vector<void*> small;
+
+    // from the frontier, between small blocks
+    for (size_t sz : {0, 1, 8, 63, 64, 65, 100, 200}) {
+        small.push_back(heap->allocate(24, "test73.cc", __LINE__));
+        void* p = heap->allocate(sz, "test73.cc", __LINE__, true);
+        assert(p);
+        memset(p, 'x', sz);
+        excl.push_back({p, sz});
+        small.push_back(heap->allocate(8, "test73.cc", __LINE__));
+    }
+    bool frontier_ok = lines_exclusive(walk, excl);
+
+    // from free blocks: fill the heap, then free runs of small blocks
+    std::vector<void*> fill;
+    while (void* p = heap->allocate(48, "test73.cc", __LINE__)) {
+        fill.push_back(p);
+    }
+    for (size_t i = 0; i + 8 < fill.size(); i += 16) {
+        for (size_t j = i + 1; j != i + 6; ++j) {
+            heap->free(fill[j], "test73.cc", __LINE__);
+            fill[j] = nullptr;
+        }
+    }
+    size_t nfree_list = 0;
+    for (int i = 0; i != 20; ++i) {
+        void* p = heap->allocate(40 + i, "test73.cc", __LINE__, true);
+        if (p) {
+            excl.push_back({p, (size_t) 40 + i});
+            ++nfree_list;
+        }
+    }
+    // small blocks refill what is left of the holes
+    while (void* q = heap->allocate(8, "test73.cc", __LINE__)) {
+        small.push_back(q);
+    }
+    bool freelist_ok = lines_exclusive(walk, excl);
+    printf("%s: frontier %s, free list %s (%zu blocks)\n", name,
+           frontier_ok ? "exclusive" : "SHARED", freelist_ok ? "exclusive" : "SHARED",
+           nfree_list);
+
+    // free everything: the heap must be whole again
+    for (auto [p, sz] : excl) {
+        heap->free(p, "test73.cc", __LINE__);
+    }
+    for (void* p : small) {
+        heap->free(p, "test73.cc", __LINE__);
+    }
+    for (void* p : fill) {
+        heap->free(p, "test73.cc", __LINE__);
+    }
+    m61_statistics stat = heap->statistics();
+    assert(stat.nactive == 0 && stat.padding_size == 0);
+    delete heap;
+}
+
+int main() {
+    check_heap<m61_heap<small_policy>>("map layout");
+    check_heap<m61_heap<small_compact_policy>>("compact layout");
+
+    // exclusive mode: one counter per thread, each on its own line
+    assert(!m61_set_exclusive(true));
+    const int nthreads = 4;
+    long* counters[nthreads];
+    for (int i = 0; i != nthreads; ++i) {
+        counters[i] = (long*) m61_calloc(1, sizeof(long));
+    }
+    char* grown = (char*) m61_realloc(nullptr, 10);
+    grown = (char*) m61_realloc(grown, 100);
+    assert(m61_set_exclusive(false));
+    void* plain = m61_malloc(8);
+    std::vector<std::pair<void*, size_t>> excl = {{grown, 100}};
+    for (int i = 0; i != nthreads; ++i) {
+        excl.push_back({counters[i], sizeof(long)});
+    }
+    printf("mode: %s\n", lines_exclusive(m61_heap_walk, excl) ? "exclusive" : "SHARED");
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i != nthreads; ++i) {
+        threads.emplace_back([c = counters[i]] {
+            for (int n = 0; n != 1000000; ++n) {
+                volatile long* v = c;
+                *v = *v + 1;
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    for (int i = 0; i != nthreads; ++i) {
+        assert(*counters[i] == 1000000);
+        m61_free(counters[i]);
+    }
+    void* e = m61_malloc_exclusive(1);
+    assert((uintptr_t) e % 64 == 0);
+    m61_free(e);
+    m61_free(grown);
+    m61_free(plain);
+    printf("done\n");
+}
+
+//! map layout: frontier exclusive, free list exclusive (20 blocks)
+//! compact layout: frontier exclusive, free list exclusive (20 blocks)
+//! mode: exclusive
+//! done
@@ -0,0 +1,70 @@
+#include "m61.hh"
+#include "m61shm.hh"
+#include <cstdio>
+#include <cassert>
+#include <cerrno>
+#include <unistd.h>
+#include <vector>
+// Check the statistics endpoint: the maintenance thread publishes the
+// heap's statistics and top sites to shared memory, a reader attached by
+// process ID sees them, and stopping removes the segment.
+
+static const char* const long_file = "some/very/long/directory/path/for/testing/test74.cc";
+
+int main() {
+    assert(m61_stats_publish(20) == 0);
+    std::vector<void*> ptrs;
+    for (int i = 0; i != 100; ++i) {
+        ptrs.push_back(m61_malloc(1000, "test74.cc", 10));
+    }
+    for (int i = 0; i != 50; ++i) {
+        ptrs.push_back(m61_malloc(16, "test74.cc", 20));
+    }
+    ptrs.push_back(m61_malloc(4, long_file, 30));
+
+    const m61_shm_stats* seg = m61_shm_attach(getpid());
+    assert(seg && seg->pid == (uint32_t) getpid() && seg->interval_ms == 20);
+    m61_shm_payload d;
+    bool seen = false;
+    for (int i = 0; i != 500 && !seen; ++i) {
+        seen = m61_shm_read(seg, &d) && d.updates != 0 && d.stats.nactive == 151;
+        if (!seen) {
+            usleep(10000);
+        }
+    }
+    assert(seen);
+    printf("published: %llu active, %llu bytes\n", d.stats.nactive, d.stats.active_size);
+    for (uint32_t i = 0; i != d.nsites; ++i) {
+        printf("site %s:%d: %llu objects, %llu bytes\n", d.sites[i].file,
+               d.sites[i].line, d.sites[i].nactive, d.sites[i].bytes);
+    }
+    // 1000 is in [512, 1024); sampled histograms may have missed them
+    assert(d.histogram_sampling != 1 || d.size_hist[10] >= 100);
+
+    // later publications follow the heap
+    for (void* p : ptrs) {
+        m61_free(p);
+    }
+    unsigned long long updates = d.updates;
+    seen = false;
+    for (int i = 0; i != 500 && !seen; ++i) {
+        seen = m61_shm_read(seg, &d) && d.updates > updates && d.stats.nactive == 0;
+        if (!seen) {
+            usleep(10000);
+        }
+    }
+    assert(seen);
+    printf("after free: %llu active, %u sites\n", d.stats.nactive, d.nsites);
+    m61_shm_detach(seg);
+
+    assert(m61_stats_publish(0) == 0);
+    seg = m61_shm_attach(getpid());
+    printf("after stop: %s\n", !seg && errno == ENOENT ? "no segment" : "SEGMENT");
+}
+
+//! published: 151 active, 100804 bytes
+//! site test74.cc:10: 100 objects, 100000 bytes
+//! site test74.cc:20: 50 objects, 800 bytes
+//! site /very/long/directory/path/for/testing/test74.cc:30: 1 objects, 4 bytes
+//! after free: 0 active, 0 sites
+//! after stop: no segment
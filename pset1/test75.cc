@@ -0,0 +1,45 @@
+#include "m61region.hh"
+#include <cstdio>
+#include <cassert>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+// Check that workers killed in the middle of region calls do not leave a
+// shared region locked for the processes still using it.
+
+int main() {
+    m61_region* r = m61_region_create_shared(1 << 20);
+    assert(r);
+    // a stuck lock would hang the test
+    alarm(10);
+    for (int round = 0; round != 20; ++round) {
+        int pfd[2];
+        int rv = pipe(pfd);
+        assert(rv == 0);
+        pid_t p = fork();
+        if (p == 0) {
+            // nearly all of this loop runs with the region locked
+            rv = write(pfd[1], "x", 1);
+            while (true) {
+                m61_region_get_statistics(r);
+            }
+        }
+        char c;
+        rv = read(pfd[0], &c, 1);
+        assert(rv == 1);
+        usleep(1000);
+        kill(p, SIGKILL);
+        waitpid(p, nullptr, 0);
+        close(pfd[0]);
+        close(pfd[1]);
+        // the dead worker may have held the lock
+        void* ptr = m61_region_malloc(r, 100);
+        assert(ptr);
+        m61_region_free(r, ptr);
+    }
+    m61_statistics stat = m61_region_get_statistics(r);
+    printf("active %llu, total %llu\n", stat.nactive, stat.ntotal);
+    m61_region_close(r);
+}
+
+//! active 0, total 20
@@ -0,0 +1,51 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+// Check that a process running the maintenance thread can fork: the child
+// allocates, restarts maintenance, and exits without waiting for the
+// parent's thread, and the parent's thread keeps working.
+
+int main() {
+    m61_maintenance_start(1);
+    std::vector<void*> ptrs;
+    for (int i = 0; i != 1000; ++i) {
+        ptrs.push_back(m61_malloc(100 + i));
+    }
+    // a hung child would hang the test
+    alarm(10);
+    for (int round = 0; round != 10; ++round) {
+        pid_t p = fork();
+        assert(p >= 0);
+        if (p == 0) {
+            for (int i = 0; i != 1000; i += 2) {
+                m61_free(ptrs[i]);
+            }
+            if (round % 2 == 0) {
+                m61_maintenance_start(1);
+                usleep(5000);
+            }
+            void* q = m61_malloc(1000);
+            assert(q);
+            // exit() runs m61_maintenance_stop()
+            exit(m61_get_statistics().nactive == 501 ? 0 : 1);
+        }
+        int status;
+        waitpid(p, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    printf("children ok\n");
+
+    for (void* p : ptrs) {
+        m61_free(p);
+    }
+    usleep(20000);
+    m61_statistics stat = m61_get_statistics();
+    printf("parent: %llu active\n", stat.nactive);
+    m61_maintenance_stop();
+}
+
+//! children ok
+//! parent: 0 active
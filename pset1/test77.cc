@@ -0,0 +1,59 @@
+#include "m61heap.hh"
+#include <cstdio>
+#include <cassert>
+// Check that free blocks maintain() has checked out for trimming still
+// appear in heap walks and statistics, in both block layouts.
+
+template <typename Heap>
+static void check_heap(const char* name) {
+    Heap* heap = new Heap;
+    void* ptrs[8];
+    for (int i = 0; i != 8; ++i) {
+        ptrs[i] = heap->allocate(100000, "test77.cc", __LINE__);
+    }
+    for (int i = 0; i != 8; i += 2) {
+        heap->free(ptrs[i], "test77.cc", __LINE__);
+    }
+    m61_statistics before = heap->statistics();
+
+    typename Heap::trim_range blocks[8];
+    size_t n = heap->maintain(64, 64 << 10, blocks, 8);
+    m61_statistics during = heap->statistics();
+
+    // the walk covers the heap without gaps, counting checked-out blocks
+    struct walk_state {
+        uintptr_t next = 0;
+        bool contiguous = true;
+        size_t nfree = 0;
+        unsigned long long free_size = 0;
+    } ws;
+    heap->walk([] (const m61_block_info* b, void* ctx) {
+        walk_state& w = *(walk_state*) ctx;
+        w.contiguous = w.contiguous && (w.next == 0 || (uintptr_t) b->ptr == w.next);
+        w.next = (uintptr_t) b->ptr + b->footprint;
+        if (b->state != M61_BLOCK_ACTIVE) {
+            ++w.nfree;
+            w.free_size += b->size;
+        }
+        return 0;
+    }, &ws);
+    printf("%s: %zu checked out, walk %s, %zu free blocks, free size %s, stats %s\n",
+           name, n, ws.contiguous ? "contiguous" : "GAPPED", ws.nfree,
+           ws.free_size == during.free_size ? "matches" : "DIFFERS",
+           during.free_size == before.free_size && during.nfree == before.nfree
+           ? "unchanged" : "CHANGED");
+
+    heap->return_trimmed(blocks, n);
+    for (int i = 1; i < 8; i += 2) {
+        heap->free(ptrs[i], "test77.cc", __LINE__);
+    }
+    delete heap;
+}
+
+int main() {
+    check_heap<m61_heap<m61_default_policy>>("map layout");
+    check_heap<m61_heap<m61_compact_policy>>("compact layout");
+}
+
+//! map layout: 4 checked out, walk contiguous, 5 free blocks, free size matches, stats unchanged
+//! compact layout: 4 checked out, walk contiguous, 5 free blocks, free size matches, stats unchanged
@@ -0,0 +1,22 @@
+#include "m61.hh"
+#include "m61shm.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <unistd.h>
+// Check that M61_STATS takes effect when the first allocation is a calloc.
+
+int main() {
+    setenv("M61_STATS", "20", 1);
+    void* a = m61_calloc(10, 10);
+    assert(a);
+    const m61_shm_stats* seg = m61_shm_attach(getpid());
+    printf("segment: %s\n", seg ? "yes" : "no");
+    if (seg) {
+        m61_shm_detach(seg);
+    }
+    m61_free(a);
+    assert(m61_stats_publish(0) == 0);
+}
+
+//! segment: yes
@@ -0,0 +1,36 @@
+#include "m61.hh"
+#include "m61shm.hh"
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+// Check that a forked child of a publishing process neither publishes into
+// nor removes its parent's statistics segment.
+
+int main() {
+    assert(m61_stats_publish(10) == 0);
+    void* a = m61_malloc(100);
+    pid_t p = fork();
+    assert(p >= 0);
+    if (p == 0) {
+        void* b = m61_malloc(200);
+        m61_free(b);
+        usleep(30000);
+        // exit() runs the atexit handlers
+        exit(m61_shm_attach(getpid()) == nullptr ? 0 : 1);
+    }
+    int status;
+    waitpid(p, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    const m61_shm_stats* seg = m61_shm_attach(getpid());
+    printf("parent segment after child exit: %s\n", seg ? "present" : "REMOVED");
+    if (seg) {
+        m61_shm_detach(seg);
+    }
+    m61_free(a);
+    assert(m61_stats_publish(0) == 0);
+}
+
+//! parent segment after child exit: present
@@ -0,0 +1,68 @@
+#include "m61heap.hh"
+#include <cstdio>
+#include <cassert>
+#include <vector>
+// Check that the per-site totals the heap keeps as blocks come and go agree
+// with a walk, in both block layouts, across frees and in-place reallocs.
+
+template <typename Heap>
+static void check_heap(const char* name) {
+    Heap* heap = new Heap;
+    std::vector<void*> ptrs;
+    for (int i = 0; i != 300; ++i) {
+        const char* file = i % 3 ? "test80.cc" : "other.cc";
+        ptrs.push_back(heap->allocate(1 + i % 40, file, 10 + i % 5));
+    }
+    for (int i = 0; i < 300; i += 4) {
+        heap->free(ptrs[i], "test80.cc", __LINE__);
+        ptrs[i] = nullptr;
+    }
+    for (int i = 1; i < 300; i += 4) {
+        // shrinking stays in place; growing past the footprint moves
+        size_t sz = i % 8 == 1 ? i % 40 : 100 + i;
+        ptrs[i] = heap->reallocate(ptrs[i], sz, "test80.cc", __LINE__);
+    }
+
+    std::vector<m61_site_total> walked;
+    heap->walk([] (const m61_block_info* b, void* ctx) {
+        auto& w = *(std::vector<m61_site_total>*) ctx;
+        if (b->state == M61_BLOCK_ACTIVE) {
+            if (b->site >= w.size()) {
+                w.resize(b->site + 1);
+            }
+            ++w[b->site].nactive;
+            w[b->site].bytes += b->size;
+        }
+        return 0;
+    }, &walked);
+    const std::vector<m61_site_total>& kept = heap->site_totals();
+    bool agree = true;
+    size_t nsites = 0;
+    for (size_t s = 0; s != std::max(walked.size(), kept.size()); ++s) {
+        m61_site_total w = s < walked.size() ? walked[s] : m61_site_total{};
+        m61_site_total k = s < kept.size() ? kept[s] : m61_site_total{};
+        agree = agree && w.nactive == k.nactive && w.bytes == k.bytes;
+        nsites += k.nactive != 0;
+    }
+    printf("%s: %zu sites, totals %s\n", name, nsites, agree ? "agree" : "DIFFER");
+
+    for (void* p : ptrs) {
+        heap->free(p, "test80.cc", __LINE__);
+    }
+    size_t left = 0;
+    for (const m61_site_total& t : heap->site_totals()) {
+        left += t.nactive + t.bytes;
+    }
+    printf("%s: %zu left after freeing all\n", name, left);
+    delete heap;
+}
+
+int main() {
+    check_heap<m61_heap<m61_default_policy>>("map layout");
+    check_heap<m61_heap<m61_compact_policy>>("compact layout");
+}
+
+//! map layout: 11 sites, totals agree
+//! map layout: 0 left after freeing all
+//! compact layout: 11 sites, totals agree
+//! compact layout: 0 left after freeing all
@@ -0,0 +1,27 @@
+#include "m61.hh"
+#include <cstdio>
+#include <thread>
+// Check that a heap used only by a thread other than main belongs to that
+// thread: its frees are local, so statistics and double-free checks see
+// them at once.
+
+int main() {
+    std::thread t([] {
+        void* p = m61_malloc(100);
+        m61_free(p);
+        m61_print_statistics();
+        fflush(stdout);
+        void* q = m61_malloc(100);
+        fprintf(stderr, "Will free %p\n", q);
+        m61_free(q);
+        m61_free(q);
+        m61_print_statistics();
+    });
+    t.join();
+}
+
+//! alloc count: active          0   total          1   fail          0
+//! alloc size:  active          0   total        100   fail          0
+//! Will free ??{0x\w+}=ptr??
+//! MEMORY BUG???: invalid free of pointer ??ptr??, double free
+//! ???
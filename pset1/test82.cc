@@ -0,0 +1,43 @@
+#include "m61.hh"
+#include <cstdio>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+// Check cross-thread frees while maintenance and publishing run: they only
+// queue their blocks, and the owner and the maintenance thread drain them.
+
+int main() {
+    m61_maintenance_start(1);
+    assert(m61_stats_publish(1) == 0);
+    std::vector<void*> ptrs;
+    for (int i = 0; i != 4000; ++i) {
+        ptrs.push_back(m61_malloc(16 + i % 200));
+    }
+    std::vector<std::thread> freers;
+    for (int t = 0; t != 4; ++t) {
+        freers.emplace_back([&ptrs, t] {
+            for (size_t i = t; i < ptrs.size(); i += 4) {
+                m61_free(ptrs[i]);
+            }
+        });
+    }
+    // the owner keeps allocating meanwhile
+    std::vector<void*> more;
+    for (int i = 0; i != 2000; ++i) {
+        more.push_back(m61_malloc(32));
+    }
+    for (auto& t : freers) {
+        t.join();
+    }
+    for (void* p : more) {
+        m61_free(p);
+    }
+    usleep(10000);
+    m61_free(m61_malloc(1));
+    printf("active %llu\n", m61_get_statistics().nactive);
+    assert(m61_stats_publish(0) == 0);
+    m61_maintenance_stop();
+}
+
+//! active 0
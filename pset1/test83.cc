@@ -0,0 +1,19 @@
+#include "m61heap.hh"
+#include <cstdio>
+#include <cstring>
+// Check that with debug checks, a compact-header heap does not take a
+// header copied into a block's payload for a real one.
+
+static m61_heap<m61_compact_policy> heap;
+
+int main() {
+    char* a = (char*) heap.allocate(100, "test83.cc", __LINE__);
+    char* p = (char*) heap.allocate(1000, "test83.cc", __LINE__);
+    // forge a's header 64 bytes into p
+    memcpy(p + 56, a - 8, 8);
+    heap.free(p + 64, "test83.cc", __LINE__);
+    printf("forged header accepted\n");
+}
+
+//! MEMORY BUG???: invalid free of pointer ???
+//! ???
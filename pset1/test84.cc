@@ -0,0 +1,53 @@
+#include "m61region.hh"
+#include <cstdio>
+#include <cassert>
+#include <unistd.h>
+#include <sys/wait.h>
+// Check that processes racing to create the same region file format it
+// exactly once, so no process loses the blocks another allocated.
+
+int main() {
+    unsigned long long total = 0;
+    for (int round = 0; round != 20; ++round) {
+        char path[] = "/tmp/m61region.XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd >= 0);
+        close(fd);
+        unlink(path);
+
+        int pfd[2];
+        int rv = pipe(pfd);
+        assert(rv == 0);
+        for (int i = 0; i != 8; ++i) {
+            if (fork() == 0) {
+                close(pfd[1]);
+                char c;
+                rv = read(pfd[0], &c, 1);
+                m61_region* r = m61_region_open(path, 1 << 20);
+                assert(r);
+                void* ptr = m61_region_malloc(r, 100);
+                assert(ptr);
+                m61_region_close(r);
+                _exit(0);
+            }
+        }
+        // start every child at once
+        close(pfd[0]);
+        close(pfd[1]);
+        int status;
+        while (wait(&status) > 0) {
+            assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+
+        m61_region* r = m61_region_open(path, 0);
+        assert(r);
+        m61_statistics stat = m61_region_get_statistics(r);
+        assert(stat.nactive == 8 && stat.ntotal == 8);
+        total += stat.ntotal;
+        m61_region_close(r);
+        unlink(path);
+    }
+    printf("total %llu\n", total);
+}
+
+//! total 160